@@ -0,0 +1,13 @@
+# All variables and this file are optional, if they are not present the PG and the
+# makefiles will try to parse the correct values from the file system.
+
+meta:
+	ADDON_NAME = ofxXeThru
+	ADDON_DESCRIPTION = XeThru X4M200/X4M300 radar modules through ModuleConnector
+	ADDON_AUTHOR = Michael Romeo
+	ADDON_TAGS = "radar" "xethru"
+	ADDON_URL =
+
+common:
+	# ofxXeThruColumnar compresses chunks with zlib
+	ADDON_LDFLAGS = -lz
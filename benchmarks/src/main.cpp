@@ -0,0 +1,245 @@
+//
+//  benchmarks for the ofxXeThru acquisition and decode path
+//
+//  usage:
+//    benchmarks /dev/cu.usbmodem1411 [seconds]
+//    benchmarks path/to/xethru_recording_meta.dat [seconds] [playback_rate]
+//
+//  A recording is replayed through ModuleConnector(DataPlayer&), so the
+//  same numbers can be produced on machines with no module attached.
+//
+
+#include "ofMain.h"
+#include "ofxXeThru.h"
+
+#include <new>
+#include <cstdlib>
+
+// every heap allocation in the process is counted
+static std::atomic<size_t> allocations{0};
+
+void * operator new(std::size_t size){
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept {
+    std::free(p);
+}
+
+static float percentile(std::vector<float> values, float p){
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, size_t(p * values.size()))];
+}
+
+static bool isRecording(const std::string & source){
+    const std::string suffix = ".dat";
+    return source.size() > suffix.size() &&
+        source.compare(source.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// read_message_data_float on its own, no addon threads involved
+static void benchmarkDecode(const std::string & source, float seconds, float rate){
+    std::unique_ptr<DataPlayer> player;
+    std::unique_ptr<ModuleConnector> mc;
+    if (isRecording(source)) {
+        player.reset(new DataPlayer(source));
+        player->set_filter(FloatDataType);
+        player->set_playback_rate(rate);
+        mc.reset(new ModuleConnector(*player, 0));
+        player->play();
+    } else {
+        mc.reset(new ModuleConnector(source, 0));
+        std::string FWID;
+        mc->get_xep().get_system_info(XTID_SSIC_FIRMWAREID, &FWID);
+        if (FWID != "XEP") {
+            mc->get_x4m300().set_sensor_mode(XTID_SM_STOP, 0);
+            mc->get_x4m300().set_sensor_mode(XTID_SM_MANUAL, 0);
+        }
+        mc->get_xep().x4driver_init();
+        XepConfig applied = XepConfig::unknown();
+        XepConfig().apply(mc->get_xep(), applied);
+    }
+    XEP & xep = mc->get_xep();
+
+    XeThru::DataFloat frame;
+    size_t frames = 0;
+    size_t bins = 0;
+    uint64_t busy = 0;
+    const uint64_t start = ofGetElapsedTimeMicros();
+    while (ofGetElapsedTimeMicros() - start < seconds * 1e6) {
+        if (xep.peek_message_data_float() == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        const uint64_t before = ofGetElapsedTimeMicros();
+        if (xep.read_message_data_float(&frame)) {
+            continue;
+        }
+        busy += ofGetElapsedTimeMicros() - before;
+        bins = frame.data.size();
+        ++frames;
+    }
+    const float elapsed = (ofGetElapsedTimeMicros() - start) / 1e6f;
+
+    std::cout << "decode" << std::endl;
+    std::cout << "  frames           " << frames << " (" << bins << " floats each)" << std::endl;
+    std::cout << "  frames/s         " << frames / elapsed << std::endl;
+    std::cout << "  us per decode    " << (frames ? float(busy) / frames : 0) << std::endl;
+    if (player) {
+        player->stop();
+    }
+}
+
+// module frame counter to frame available in the app, through ofxXeThru
+static void benchmarkLatency(const std::string & source, float seconds, float rate){
+    ofxXeThru sensor;
+    if (isRecording(source)) {
+        sensor.setupPlayback(source, rate);
+    } else {
+        sensor.setup(source);
+    }
+    const float fps = sensor.getConfig().fps * (isRecording(source) ? rate : 1);
+
+    std::vector<float> queue_latency;
+    std::vector<float> counter_latency;
+    queue_latency.reserve(100000);
+    counter_latency.reserve(100000);
+
+    ofxXeThruFrame frame;
+    bool first = true;
+    uint32_t first_counter = 0;
+    uint64_t first_time = 0;
+    size_t frames = 0;
+    size_t steady_allocations = 0;
+    const uint64_t start = ofGetElapsedTimeMicros();
+    while (ofGetElapsedTimeMicros() - start < seconds * 1e6) {
+        const size_t before = allocations.load();
+        if (!sensor.getNextFrame(frame)) {
+            sensor.waitForFrame(100);
+            continue;
+        }
+        const uint64_t now = ofGetElapsedTimeMicros();
+        // the first frames grow the buffers, count allocations after that
+        if (frames > 10) {
+            steady_allocations += allocations.load() - before;
+        }
+        ++frames;
+
+        // time in the addon's queue
+        queue_latency.push_back((now - frame.timestamp) / 1000.0f);
+
+        // when the module should have produced this frame, from its counter.
+        // There's no shared clock, so this is relative to the first frame.
+        if (first) {
+            first = false;
+            first_counter = frame.info;
+            first_time = now;
+        }
+        const double expected = first_time + (frame.info - first_counter) * 1e6 / fps;
+        counter_latency.push_back((now - expected) / 1000.0f);
+    }
+    const uint64_t dropped = sensor.getDroppedFrames();
+    const uint64_t gaps = sensor.getFrameGaps();
+    const uint64_t missing = sensor.getMissingFrames();
+    sensor.stop();
+
+    // the first frame defines zero, shift so the best case is zero instead
+    if (!counter_latency.empty()) {
+        const float best = *std::min_element(counter_latency.begin(), counter_latency.end());
+        for (float & value : counter_latency) {
+            value -= best;
+        }
+    }
+
+    std::cout << "end to end" << std::endl;
+    std::cout << "  frames                  " << frames << std::endl;
+    std::cout << "  queue latency p50/p99   " << percentile(queue_latency, 0.5) << " / " << percentile(queue_latency, 0.99) << " ms" << std::endl;
+    std::cout << "  counter latency p50/p99 " << percentile(counter_latency, 0.5) << " / " << percentile(counter_latency, 0.99) << " ms" << std::endl;
+    std::cout << "  dropped in queue        " << dropped << std::endl;
+    std::cout << "  counter gaps (frames)   " << gaps << " (" << missing << ")" << std::endl;
+    std::cout << "  app allocations/frame   " << (frames > 11 ? float(steady_allocations) / (frames - 11) : 0) << std::endl;
+}
+
+// cost of one push/pop through the queue and one publish/read through the
+// triple buffer, writer and reader on separate threads. No hardware needed.
+static void benchmarkHandoff(size_t bins){
+    const size_t count = 200000;
+
+    ofxXeThruRingBuffer<ofxXeThruFrame> ring;
+    ring.allocate(32, [bins](XeThru::DataFloat & frame){ frame.data.resize(bins); });
+    ofxXeThruFrame source;
+    source.data.resize(bins);
+
+    const size_t before = allocations.load();
+    uint64_t start = ofGetElapsedTimeMicros();
+    std::thread producer([&]{
+        for (size_t n = 0; n < count; ++n) {
+            source.info = n;
+            while (!ring.push(source)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+    ofxXeThruFrame sink;
+    sink.data.resize(bins);
+    for (size_t n = 0; n < count; ++n) {
+        while (!ring.pop(sink)) {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    const float ring_us = float(ofGetElapsedTimeMicros() - start) / count;
+    const size_t ring_allocations = allocations.load() - before;
+
+    ofxXeThruTripleBuffer<ofxXeThruFrame> triple;
+    triple.allocate([bins](XeThru::DataFloat & frame){ frame.data.resize(bins); });
+    std::atomic<bool> done{false};
+    size_t reads = 0;
+    start = ofGetElapsedTimeMicros();
+    std::thread writer([&]{
+        for (size_t n = 0; n < count; ++n) {
+            ofxXeThruFrame & frame = triple.getWriteBuffer();
+            std::copy(source.data.begin(), source.data.end(), frame.data.begin());
+            frame.info = n;
+            triple.publish();
+        }
+        done = true;
+    });
+    while (!done) {
+        if (triple.hasNew()) {
+            triple.read();
+            ++reads;
+        }
+    }
+    writer.join();
+    const float triple_us = float(ofGetElapsedTimeMicros() - start) / count;
+
+    std::cout << "handoff (" << bins << " floats)" << std::endl;
+    std::cout << "  ring push+pop          " << ring_us << " us, " << ring_allocations << " allocations" << std::endl;
+    std::cout << "  triple publish         " << triple_us << " us, " << reads << " reads" << std::endl;
+}
+
+//========================================================================
+int main(int argc, char * argv[]){
+
+    if (argc < 2) {
+        std::cout << "usage: " << argv[0] << " <device | xethru_recording_meta.dat> [seconds] [playback_rate]" << std::endl;
+        return 1;
+    }
+    const std::string source = argv[1];
+    const float seconds = argc > 2 ? std::atof(argv[2]) : 10;
+    const float rate = argc > 3 ? std::atof(argv[3]) : 1;
+
+    benchmarkHandoff(ofxXeThruFramePool::getFrameCapacity(0.4, 5.0, false));
+    benchmarkDecode(source, seconds, rate);
+    benchmarkLatency(source, seconds, rate);
+
+    return 0;
+}
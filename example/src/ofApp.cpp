@@ -6,21 +6,57 @@ void ofApp::setup(){
     //note: to search for serial device address open terminal:
     // ls /dev/cu.*
     sensor.setup("/dev/cu.usbmodem1411");
+
+    // RF samples, tune the range to your dac and frame area settings
+    waterfall.setRange(-0.02, 0.02);
+    // one row per frame, resized if the frames come in with other bins
+    const XepConfig config = sensor.getConfig();
+    waterfall.setup(ofxXeThruFramePool::getFrameCapacity(config.fa1, config.fa2, config.dc));
+
+    // per sensor rates, latency and queues, press d to hide
+    dashboard.add(sensor);
 }
 
 //--------------------------------------------------------------
 void ofApp::update(){
 
+    if (sensor.hasNewFrame()) {
+        waterfall.addFrame(sensor.getLatestFrame());
+    }
+    dashboard.update();
+
 }
 
 //--------------------------------------------------------------
 void ofApp::draw(){
 
+    waterfall.draw(0, 0, ofGetWidth(), ofGetHeight());
+
+    // newest radar frame, one vertex per bin
+    const XeThru::DataFloat & frame = sensor.getLatestFrame();
+    const size_t bins = frame.data.size();
+    if (bins > 1) {
+        line.clear();
+        float step = ofGetWidth() / float(bins - 1);
+        for (size_t x = 0; x < bins; ++x) {
+            line.addVertex(x * step, ofGetHeight() * 0.5 - frame.data[x] * ofGetHeight() * 0.5);
+        }
+        line.draw();
+    }
+
+    if (show_dashboard) {
+        dashboard.draw(10, 20);
+    }
+
 }
 
 //--------------------------------------------------------------
 void ofApp::keyPressed(int key){
 
+    if (key == 'd') {
+        show_dashboard = !show_dashboard;
+    }
+
 }
 
 //--------------------------------------------------------------
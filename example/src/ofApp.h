@@ -2,6 +2,8 @@
 
 #include "ofMain.h"
 #include "ofxXeThru.h"
+#include "ofxXeThruWaterfall.h"
+#include "ofxXeThruDashboard.h"
 
 class ofApp : public ofBaseApp{
 
@@ -23,5 +25,9 @@ class ofApp : public ofBaseApp{
 		void gotMessage(ofMessage msg);
     
     ofxXeThru sensor;
+    ofPolyline line;
+    ofxXeThruWaterfall waterfall;
+    ofxXeThruDashboard dashboard;
+    bool show_dashboard = true;
 		
 };
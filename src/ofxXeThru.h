@@ -6,48 +6,723 @@
 //
 //
 
+#pragma once
+
+#include "ofMain.h"
+
 #include "XEP.hpp"
 #include "Data.hpp"
 #include "xtid.h"
 #include "X4M300.hpp"
 #include "ModuleConnector.hpp"
+#include "DataPlayer.hpp"
+
+#include "ofxXeThruRingBuffer.h"
+#include "ofxXeThruTripleBuffer.h"
+#include "ofxXeThruFrame.h"
+#include "ofxXeThruFramePool.h"
+#include "ofxXeThruConfig.h"
+#include "ofxXeThruBaudrate.h"
+#include "ofxXeThruRecorder.h"
+#include "ofxXeThruColumnar.h"
+#include "ofxXeThruPublisher.h"
+#include "ofxXeThruSubscriptions.h"
+#include "ofxXeThruSignal.h"
+#include "ofxXeThruView.h"
+#include "ofxXeThruTrace.h"
+#include "ofxXeThruHistogram.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#include <functional>
+#include <future>
 
 using namespace XeThru;
 
-class ofxXeThru {
-    
+// what the acquisition thread does when getNextFrame() isn't keeping up
+enum ofxXeThruOverflow {
+    // the new frame is discarded, latency stays bounded by the queue size
+    OFXXETHRU_DROP_NEWEST,
+    // the oldest queued frame is discarded, the queue holds the newest
+    OFXXETHRU_DROP_OLDEST,
+    // acquisition waits for room, frames back up in ModuleConnector
+    OFXXETHRU_BLOCK,
+};
+
+class ofxXeThru : public ofThread {
+
 public:
-    
-    void setup(string _serialID){
-        
-        const std::string device_name = _serialID;
-        return read_frame(device_name);
-        
+
+    ~ofxXeThru(){
+        stop();
+    }
+
+    // opens the module on a background thread, setup() returns right away
+    void setup(string _serialID, int _deviceID = 0){
+
+        device_name = _serialID;
+        device_id = _deviceID;
+        meta_filename.clear();
+        start();
+
+    }
+
+    // replays the FloatDataType records of a recording through
+    // ModuleConnector(DataPlayer&) instead of opening a module. Given a
+    // directory of ofxXeThruColumnar chunks instead, its float chunks are
+    // replayed, paced on their epochs and decompressed as they are read.
+    void setupPlayback(const std::string & _metaFilename, float _playbackRate = 1.0, int _deviceID = 0){
+
+        device_name = _metaFilename;
+        device_id = _deviceID;
+        meta_filename = _metaFilename;
+        playback_rate = _playbackRate;
+        start();
+
+    }
+
+    void stop(){
+        waitForThread(true);
+    }
+
+    // true once the module is configured and streaming
+    bool isConnected() const {
+        return connected;
+    }
+
+    // takes effect on the acquisition thread, only changed settings are sent
+    void setConfig(const XepConfig & _config){
+        lock();
+        config = _config;
+        config_changed = true;
+        unlock();
+        configured_fps = _config.fps;
+    }
+
+    // the fps of the last setConfig(), without the lock getConfig() takes
+    int getConfiguredFps() const {
+        return configured_fps;
+    }
+
+    XepConfig getConfig(){
+        lock();
+        XepConfig result = config;
+        unlock();
+        return result;
+    }
+
+    // call before setup(). When set, the link is stepped up to the highest
+    // rate up to max_rate that passes ping(). 0 keeps the default rate.
+    void setMaxBaudrate(uint32_t max_rate){
+        max_baudrate = max_rate;
+    }
+
+    // rate the link settled on
+    uint32_t getBaudrate() const {
+        return baudrate;
+    }
+
+    // call before setup(). On by default: a module that drops off the
+    // link is reopened in place, frames queued so far and the recorder
+    // and publisher hooks stay as they are.
+    void setAutoReconnect(bool enabled){
+        auto_reconnect = enabled;
+    }
+
+    // times the link was lost and got back
+    uint64_t getReconnects() const {
+        return reconnects;
+    }
+
+    // last time from losing the link to streaming again, microseconds
+    uint64_t getLastRecoveryTime() const {
+        return last_recovery_micros;
+    }
+
+    // ping() the module every interval seconds while streaming, the round
+    // trip bounds the link latency for ofxXeThruSync. 0 turns it off.
+    void setPingInterval(float seconds){
+        ping_interval = seconds;
+    }
+
+    // shortest ping() round trip since connecting, microseconds, 0 before
+    // the first ping
+    uint64_t getPingRoundTrip() const {
+        return ping_round_trip;
+    }
+
+    // payload bytes per second received over the last second
+    float getThroughput() const {
+        return throughput;
+    }
+
+    // frames per second received over the last second, to hold against
+    // the configured fps
+    float getFps() const {
+        return measured_fps;
+    }
+
+    // frames ModuleConnector had queued at the last look, a backlog means
+    // the acquisition thread is the one falling behind
+    int getModuleQueueDepth() const {
+        return module_queue_depth;
+    }
+
+    // share of one core the acquisition thread used over the last second
+    float getCpuLoad() const {
+        return cpu_load;
+    }
+
+    // microseconds from receiving a frame to handing it out through
+    // getNextFrame() or getLatestFrame()
+    const ofxXeThruHistogram & getLatency() const {
+        return latency;
+    }
+
+    const std::string & getDeviceName() const {
+        return device_name;
+    }
+
+    int getDeviceID() const {
+        return device_id;
+    }
+
+    // main thread side, never blocks on the serial port
+    bool hasNewFrame() const {
+        return latest.hasNew();
+    }
+
+    // newest frame, valid until the next call. No lock and no copy.
+    const ofxXeThruFrame & getLatestFrame(){
+        const bool fresh = latest.hasNew();
+        const ofxXeThruFrame & frame = latest.read();
+        if (fresh) {
+            latency.record(ofGetElapsedTimeMicros() - frame.timestamp);
+        }
+        return frame;
+    }
+
+    // every frame in arrival order, for consumers that can't skip frames
+    bool getNextFrame(ofxXeThruFrame & frame){
+        if (pop(frame)) {
+            latency.record(ofGetElapsedTimeMicros() - frame.timestamp);
+#ifdef OFXXETHRU_TRACE
+            // time spent queued, from the acquisition timestamp
+            const uint64_t end = ofxXeThruTrace::now();
+            OFXXETHRU_TRACE_SPAN("ofxXeThru queue", end - (ofGetElapsedTimeMicros() - frame.timestamp) * 1000, end);
+#endif
+            return true;
+        }
+        rearm();
+        return false;
+    }
+
+    // same, copied into a fixed buffer from an ofxXeThruFramePool
+    bool getNextFrame(ofxXeThruFrameBuffer & frame){
+        return getNextFrame(next) && ofxXeThruFramePool::copy(next, frame);
+    }
+
+    // blocks until getNextFrame() has a frame, false on timeout
+    bool waitForFrame(uint64_t timeout_ms){
+        return frame_signal.wait(timeout_ms, [this]{ return !frames.empty(); });
+    }
+
+    // readable while getNextFrame() may have frames, for poll/epoll/kqueue
+    // loops over several sensors. Read frames until getNextFrame() returns
+    // false, that clears it.
+    int getFileDescriptor() const {
+        return frame_signal.getFileDescriptor();
+    }
+
+    // floats per frame for the configured frame area and downconversion
+    size_t getFrameCapacity() const {
+        return frame_capacity;
+    }
+
+    // call before setup(), rounded up to a power of two
+    void setFrameQueueSize(size_t size){
+        frame_queue_size = size;
+    }
+
+    // call before setup()
+    void setOverflowPolicy(ofxXeThruOverflow policy){
+        overflow = policy;
+    }
+
+    // frames waiting in getNextFrame()'s queue
+    size_t getQueueDepth() const {
+        return frames.size();
+    }
+
+    // discarded by the overflow policy
+    uint64_t getDroppedFrames() const {
+        return dropped_frames;
+    }
+
+    // jumps in the module's frame counter (DataFloat::info), i.e. frames
+    // lost before they reached this addon, and how many frames they span
+    uint64_t getFrameGaps() const {
+        return frame_gaps;
+    }
+
+    uint64_t getMissingFrames() const {
+        return missing_frames;
+    }
+
+    // every frame is also queued on the recorder, from the acquisition
+    // thread. nullptr stops. One recorder per sensor.
+    void setRecorder(ofxXeThruRecorder * _recorder){
+        recorder = _recorder;
+    }
+
+    // Call before setup(). A range window (meters, both 0 for the whole
+    // frame) at its own rate (0 for every frame) that only costs anything
+    // when pulled. Views share one short history of the stream, each one
+    // is for a single consumer thread and lives as long as the sensor.
+    ofxXeThruView & addView(float range_start = 0, float range_end = 0, float fps = 0){
+        views.emplace_back(new ofxXeThruView(history, range_start, range_end, fps));
+        return *views.back();
+    }
+
+    // every frame is also published, from the acquisition thread. One
+    // publisher can serve several sensors. nullptr stops.
+    void setPublisher(ofxXeThruPublisher * _publisher){
+        publisher = _publisher;
+    }
+
+    // Call before setup(), with the callbacks registered. The readers are
+    // started on this sensor's connector once it streams, stopped before
+    // a lost link is reopened and started again on it, so the callbacks
+    // carry on across a reconnect. Live modules only.
+    void setSubscriptions(ofxXeThruSubscriptions * _subscriptions){
+        subscriptions = _subscriptions;
+    }
+
+    // Runs job on the acquisition thread between two frames, with the
+    // module to itself: file transfers and other calls that must not race
+    // the stream. Frames wait in ModuleConnector meanwhile. The future
+    // gets what job returned, or 1 when the sensor stopped first or the
+    // job was cancelled. id, when given, is for cancelJob().
+    std::future<int> runOnModule(std::function<int(XEP &)> job, uint64_t * id = nullptr){
+        std::promise<int> result;
+        std::future<int> future = result.get_future();
+        std::lock_guard<std::mutex> guard(job_mutex);
+        const uint64_t job_id = ++last_job_id;
+        if (id != nullptr) {
+            *id = job_id;
+        }
+        if (!accepting_jobs) {
+            result.set_value(1);
+            return future;
+        }
+        jobs.push_back(Job{job_id, std::move(job), std::move(result)});
+        jobs_pending = true;
+        return future;
+    }
+
+    // takes back a job that hasn't started, e.g. one waiting on a module
+    // that is gone, its future gets 1. false once it is running or done.
+    bool cancelJob(uint64_t id){
+        std::lock_guard<std::mutex> guard(job_mutex);
+        for (auto job = jobs.begin(); job != jobs.end(); ++job) {
+            if (job->id == id) {
+                job->result.set_value(1);
+                jobs.erase(job);
+                jobs_pending = !jobs.empty();
+                return true;
+            }
+        }
+        return false;
     }
 
-    
 
 private:
-    
+
     //config values/
-    int dac_min = 949;
-    int dac_max = 1100;
-    int iteration = 32;
-    int pps = 150;
-    int fps = 17;
-    float offset = 0.18;
-    float fa1 = 0.4;
-    float fa2 = 5.0;
-    int dc = 0;
-    
-    
-    
+    XepConfig config;
+    std::atomic<bool> config_changed{false};
+    std::atomic<int> configured_fps{0};
+
+    std::string device_name;
+    int device_id = 0;
+    std::atomic<bool> connected{false};
+
+    uint32_t max_baudrate = 0;
+    std::atomic<uint32_t> baudrate{0};
+    std::atomic<float> throughput{0};
+    std::atomic<float> measured_fps{0};
+    std::atomic<int> module_queue_depth{0};
+    std::atomic<float> cpu_load{0};
+    ofxXeThruHistogram latency;
+
+    // acquisition thread only, the settings the module acknowledged. Kept
+    // across a reconnect so only what the module lost is sent again.
+    XepConfig applied = XepConfig::unknown();
+    bool auto_reconnect = true;
+    std::atomic<uint64_t> reconnects{0};
+    std::atomic<uint64_t> last_recovery_micros{0};
+    uint64_t recovery_start = 0;
+
+    static const int max_read_failures = 3;
+    static const int stall_periods = 4;
+    static const uint64_t min_stall_micros = 250000;
+    static const int reconnect_interval = 20;
+
+    std::atomic<float> ping_interval{0};
+    std::atomic<uint64_t> ping_round_trip{0};
+
+    // frames waiting to be picked up by the main thread
+    size_t frame_queue_size = 32;
+    ofxXeThruOverflow overflow = OFXXETHRU_DROP_NEWEST;
+    ofxXeThruRingBuffer<ofxXeThruFrame> frames;
+    ofxXeThruSignal frame_signal;
+    // room in the queue again, OFXXETHRU_BLOCK only
+    ofxXeThruSignal space_signal;
+    // OFXXETHRU_DROP_OLDEST pops from the acquisition thread too
+    std::mutex pop_mutex;
+    ofxXeThruFrame discarded;
+
+    std::atomic<uint64_t> dropped_frames{0};
+    std::atomic<uint64_t> frame_gaps{0};
+    std::atomic<uint64_t> missing_frames{0};
+    bool counting = false;
+    uint32_t last_counter = 0;
+
+    // newest frame only, for drawing
+    ofxXeThruTripleBuffer<ofxXeThruFrame> latest;
+
+    // main thread scratch frame for the fixed buffer getNextFrame()
+    ofxXeThruFrame next;
+    size_t frame_capacity = 0;
+
+    std::atomic<ofxXeThruRecorder *> recorder{nullptr};
+    std::atomic<ofxXeThruPublisher *> publisher{nullptr};
+    ofxXeThruSubscriptions * subscriptions = nullptr;
+
+    // frames for the views, only allocated when there are any
+    static const size_t history_size = 32;
+    ofxXeThruFrameHistory history;
+    std::vector<std::unique_ptr<ofxXeThruView>> views;
+
+    // runOnModule() jobs, taken by the acquisition thread
+    struct Job {
+        uint64_t id;
+        std::function<int(XEP &)> run;
+        std::promise<int> result;
+    };
+    std::mutex job_mutex;
+    std::vector<Job> jobs;
+    std::atomic<bool> jobs_pending{false};
+    uint64_t last_job_id = 0;
+    // under job_mutex, from start() until the thread stops taking jobs
+    bool accepting_jobs = false;
+
+    // set for playback
+    std::string meta_filename;
+    float playback_rate = 1.0;
+
+    // consumer side of the frame queue
+    bool pop(ofxXeThruFrame & frame){
+        if (overflow == OFXXETHRU_DROP_OLDEST) {
+            std::lock_guard<std::mutex> guard(pop_mutex);
+            return frames.pop(frame);
+        }
+        if (!frames.pop(frame)) {
+            return false;
+        }
+        if (overflow == OFXXETHRU_BLOCK) {
+            space_signal.notify();
+        }
+        return true;
+    }
+
+    // producer side, applies the overflow policy
+    void push(const ofxXeThruFrame & frame){
+        if (frames.push(frame)) {
+            return;
+        }
+        if (overflow == OFXXETHRU_DROP_OLDEST) {
+            std::lock_guard<std::mutex> guard(pop_mutex);
+            // the consumer may have made room in the meantime
+            if (!frames.push(frame)) {
+                frames.pop(discarded);
+                frames.push(frame);
+                ++dropped_frames;
+            }
+            return;
+        }
+        if (overflow == OFXXETHRU_BLOCK) {
+            while (isThreadRunning()) {
+                if (frames.push(frame)) {
+                    return;
+                }
+                space_signal.wait(10, [this]{ return frames.size() < frames.capacity(); });
+            }
+        }
+        ++dropped_frames;
+    }
+
+    // No frame for several frame periods while the module should be
+    // streaming. Counts as lost once the device file is gone or the
+    // module doesn't answer, a module that answers just gets more time.
+    bool stalled(XEP & xep, uint64_t & last_frame){
+        if (applied.fps <= 0) {
+            return false;
+        }
+        const uint64_t now = ofGetElapsedTimeMicros();
+        const uint64_t timeout = std::max<uint64_t>(uint64_t(min_stall_micros), stall_periods * 1000000ull / applied.fps);
+        if (now - last_frame < timeout) {
+            return false;
+        }
+        if (access(device_name.c_str(), F_OK) != 0) {
+            return true;
+        }
+        uint32_t pong = 0;
+        if (xep.ping(&pong)) {
+            return true;
+        }
+        last_frame = now;
+        return false;
+    }
+
+    // keeps the shortest round trip, the one least delayed by frames
+    // queued on the link ahead of the pong
+    void ping(XEP & xep){
+        OFXXETHRU_TRACE_SCOPE("XEP::ping");
+        uint32_t pong = 0;
+        const uint64_t begin = ofGetElapsedTimeMicros();
+        if (xep.ping(&pong)) {
+            return;
+        }
+        const uint64_t round_trip = ofGetElapsedTimeMicros() - begin;
+        if (ping_round_trip == 0 || round_trip < ping_round_trip) {
+            ping_round_trip = round_trip;
+        }
+    }
+
+    // CPU time of the calling thread, microseconds
+    static uint64_t getThreadCpuTime(){
+        timespec t;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+        return uint64_t(t.tv_sec) * 1000000 + t.tv_nsec / 1000;
+    }
+
+    // a counter that goes back is a module restart, not a gap
+    void countGap(uint32_t counter){
+        const uint32_t step = counter - last_counter;
+        if (counting && step > 1 && step < 0x80000000u) {
+            ++frame_gaps;
+            missing_frames += step - 1;
+        }
+        counting = true;
+        last_counter = counter;
+    }
+
+    // queue found empty, clear the descriptor unless a frame just came in
+    void rearm(){
+        frame_signal.reset();
+        if (!frames.empty()) {
+            frame_signal.notify();
+        }
+    }
+
+    // sizes the buffers and starts the acquisition thread
+    void start(){
+        connected = false;
+        configured_fps = config.fps;
+
+        // every slot gets room for a full frame up front so the decoder
+        // never has to grow a vector while streaming
+        frame_capacity = ofxXeThruFramePool::getFrameCapacity(config.fa1, config.fa2, config.dc);
+        auto reserve = [this](XeThru::DataFloat & frame){
+            ofxXeThruFramePool::reserve(frame, frame_capacity);
+        };
+        frames.allocate(frame_queue_size, reserve);
+        latest.allocate(reserve);
+        reserve(next);
+        reserve(discarded);
+        if (!views.empty()) {
+            // room for the largest area, a config change never cuts frames
+            history.allocate(history_size, std::max(frame_capacity, ofxXeThruFramePool::getFrameCapacity(0, 10, false)));
+        }
+        dropped_frames = 0;
+        frame_gaps = 0;
+        missing_frames = 0;
+        counting = false;
+        {
+            std::lock_guard<std::mutex> guard(job_mutex);
+            accepting_jobs = true;
+        }
+
+        startThread();
+    }
+
+    void threadedFunction(){
+        OFXXETHRU_TRACE_THREAD("ofxXeThru acquisition");
+        if (meta_filename.empty()) {
+            read_frame(device_name);
+        } else {
+            std::vector<std::string> chunks;
+            if (ofxXeThruColumnar::readIndex(meta_filename, FloatDataType, chunks) == 0) {
+                play_chunks(chunks);
+            } else {
+                play_frames(meta_filename);
+            }
+        }
+        // jobs that never got to run
+        failJobs();
+    }
+
+    // fails what is queued and everything queued from now on, until the
+    // next start()
+    void failJobs(){
+        std::lock_guard<std::mutex> guard(job_mutex);
+        accepting_jobs = false;
+        for (Job & job : jobs) {
+            job.result.set_value(1);
+        }
+        jobs.clear();
+        jobs_pending = false;
+    }
+
+    void runJobs(XEP & xep){
+        std::vector<Job> running;
+        {
+            std::lock_guard<std::mutex> guard(job_mutex);
+            running.swap(jobs);
+            jobs_pending = false;
+        }
+        for (Job & job : running) {
+            OFXXETHRU_TRACE_SCOPE("ofxXeThru job");
+            job.result.set_value(job.run(xep));
+        }
+    }
+
+    int play_frames(const std::string & meta_filename)
+    {
+        DataPlayer player(meta_filename);
+        player.set_filter(FloatDataType);
+        player.set_playback_rate(playback_rate);
+        ModuleConnector mc(player, 0);
+        player.play();
+        // a recording can't be configured, only read
+        connected = true;
+        stream(mc.get_xep(), false);
+        player.stop();
+        connected = false;
+        return 0;
+    }
+
+    // Chunks hold the frame counter and the data, content_id comes back 0.
+    // A chunk recording has no module behind it, jobs fail right away.
+    int play_chunks(const std::vector<std::string> & files)
+    {
+        failJobs();
+        connected = true;
+        Meter meter;
+        startMeter(meter);
+        // recordings are read with the settings they were made with
+        const ofxXeThruFrameHistory::Area area = getArea(getConfig());
+        ofxXeThruColumnar::Chunk chunk;
+        int64_t first_epoch = 0;
+        uint64_t start = 0;
+        for (size_t c = 0; c < files.size() && isThreadRunning(); ++c) {
+            if (chunk.open(files[c])) {
+                ofLogError("ofxXeThru") << "could not read " << files[c];
+                continue;
+            }
+            for (uint32_t f = 0; f < chunk.getFrames() && isThreadRunning(); ++f) {
+                const int64_t epoch = chunk.getEpochs()[f];
+                if (start == 0) {
+                    first_epoch = epoch;
+                    start = ofGetElapsedTimeMicros();
+                }
+                if (playback_rate > 0) {
+                    // short sleeps so stop() isn't held up by a gap
+                    const uint64_t due = start + uint64_t((epoch - first_epoch) * 1000 / playback_rate);
+                    for (uint64_t now = ofGetElapsedTimeMicros(); now < due && isThreadRunning(); now = ofGetElapsedTimeMicros()) {
+                        usleep(std::min<uint64_t>(due - now, 10000));
+                    }
+                }
+                ofxXeThruFrame & frame = latest.getWriteBuffer();
+                const float * row = chunk.getRow(0, f);
+                frame.content_id = 0;
+                frame.info = chunk.getFrameCounters()[f];
+                frame.data.assign(row, row + chunk.getBins());
+                frame.device_id = device_id;
+                frame.timestamp = ofGetElapsedTimeMicros();
+                measure(meter, frame);
+                handoff(frame, area);
+            }
+        }
+        chunk.close();
+        connected = false;
+        return 0;
+    }
+
     int read_frame(const std::string & device_name)
     {
         const unsigned int log_level = 0;
         ModuleConnector mc(device_name, log_level);
+        bool initialised = false;
+
+        while (true) {
+            if (!initialised) {
+                if (!initialise(mc)) {
+                    if (!auto_reconnect || !isThreadRunning()) {
+                        return 1;
+                    }
+                    // reopened at the default rate and brought up again,
+                    // a moment later so a failing link isn't hammered
+                    recovery_start = ofGetElapsedTimeMicros();
+                    sleep(reconnect_interval);
+                    if (!reconnect(mc, initialised)) {
+                        return 1;
+                    }
+                    continue;
+                }
+                initialised = true;
+            }
+            config_changed = true;
+            connected = true;
+            if (recovery_start > 0) {
+                last_recovery_micros = ofGetElapsedTimeMicros() - recovery_start;
+                recovery_start = 0;
+                ofLogNotice("ofxXeThru") << device_name << " back after " << last_recovery_micros / 1000 << " ms";
+            }
+
+            if (subscriptions != nullptr && !subscriptions->empty()) {
+                subscriptions->start(mc);
+            }
+            const bool lost = stream(mc.get_xep(), true);
+            connected = false;
+            // the readers leave the connector before it is closed
+            if (subscriptions != nullptr) {
+                subscriptions->stop();
+            }
+            if (!lost) {
+                break;
+            }
+            recovery_start = ofGetElapsedTimeMicros();
+            ofLogWarning("ofxXeThru") << "lost " << device_name << ", reconnecting";
+            if (!reconnect(mc, initialised)) {
+                return 1;
+            }
+            ++reconnects;
+        }
+
+        // stop streaming before the connector closes the port
+        mc.get_xep().x4driver_set_fps(0);
+        return 0;
+    }
+
+    // the full bring up, on the first connect or after the module reset.
+    // false when the link didn't survive the baud rate negotiation.
+    bool initialise(ModuleConnector & mc)
+    {
         XEP & xep = mc.get_xep();
-        
+
         std::string FWID;
         //If the module is a X4M200 or X4M300 it needs to be put in manual mode
         xep.get_system_info(0x02, &FWID);
@@ -58,45 +733,194 @@ private:
             x4m300.set_sensor_mode(XTID_SM_STOP,0);
             x4m300.set_sensor_mode(XTID_SM_MANUAL,0);
             xep.get_system_info(0x01, &Module);
-            std::cout << "Module " << Module << " set to XEP mode"<< std::endl;
+            ofLogNotice("ofxXeThru") << "Module " << Module << " set to XEP mode";
+        }
+
+        baudrate = ofxXeThruBaudrate::default_rate;
+        if (max_baudrate > 0) {
+            baudrate = ofxXeThruBaudrate::negotiate(xep, max_baudrate);
+            if (baudrate == 0) {
+                ofLogError("ofxXeThru") << "no working baud rate on " << device_name;
+                return false;
+            }
+            ofLogNotice("ofxXeThru") << device_name << " running at " << baudrate << " baud";
         }
-        
+
         // Configure XEP
-        
+
         xep.x4driver_init();
-        xep.x4driver_set_dac_min(dac_min);
-        xep.x4driver_set_dac_max(dac_max);
-        xep.x4driver_set_iterations(iteration);
-        xep.x4driver_set_pulses_per_step(pps);
-        xep.x4driver_set_fps(fps);
-        xep.x4driver_set_frame_area_offset(offset);
-        xep.x4driver_set_frame_area(fa1, fa2);
-        xep.x4driver_set_downconversion(dc);
-
-        
-        // DataFloat
-        XeThru::DataFloat test;
-        // Check packets queue
-        int packets = xep.peek_message_data_float();
-        std::cout << "Packets in queue: " << packets<<'\n';
-        
-        // Printing output until KeyboardInterrupt
-        // This data is not readable.
-        std::cout << "Printing out data: " << '\n';
-        while (true) {
-            if (xep.read_message_data_float(&test)) {
-                
-                //stopped working
+        applied = XepConfig::unknown();
+        return true;
+    }
+
+    // Reopens the same connector once the device file is back, so the
+    // frame queues, recorder and publisher carry on untouched. When the
+    // module kept its driver state (a host side USB hiccup) initialised
+    // stays true and only settings that differ from the cached applied
+    // state are sent again. false when the thread was stopped meanwhile.
+    bool reconnect(ModuleConnector & mc, bool & initialised)
+    {
+        OFXXETHRU_TRACE_SCOPE("ofxXeThru reconnect");
+        mc.close();
+        while (isThreadRunning()) {
+            // unplugged modules take their device file with them
+            if (access(device_name.c_str(), F_OK) == 0 && mc.open(device_name) == 0) {
+                if (ofxXeThruBaudrate::verify(mc.get_xep(), 1)) {
+                    break;
+                }
+                mc.close();
             }
-            std::vector<float> outData = test.data;
-            int sz = outData.size();
-            for (int x = 0; x < sz; ++x) {
-                //printing out unreadable RF-data
-                std::cout << test.data[x] << " ";
+            sleep(reconnect_interval);
+        }
+        if (!isThreadRunning()) {
+            return false;
+        }
+        float fps = 0;
+        if (applied.fps > 0 && mc.get_xep().x4driver_get_fps(&fps) == 0 && int(fps + 0.5f) == applied.fps) {
+            ofLogNotice("ofxXeThru") << device_name << " kept its settings";
+        } else {
+            // reset or power cycled, the driver starts from scratch
+            initialised = false;
+        }
+        return true;
+    }
+
+    // Reads until the thread is stopped, applying config changes in
+    // between. Live, it returns true when the link is lost: reads keep
+    // failing, or frames stop and the module doesn't answer a ping.
+    bool stream(XEP & xep, bool configure)
+    {
+        if (!configure) {
+            applied = XepConfig::unknown();
+        }
+        Meter meter;
+        startMeter(meter);
+        uint64_t last_ping = 0;
+        ping_round_trip = 0;
+        uint64_t last_frame = ofGetElapsedTimeMicros();
+        int read_failures = 0;
+        const bool watch = configure && auto_reconnect;
+        // the area frames come in with, for the views. Recordings are
+        // read with the settings they were made with.
+        ofxXeThruFrameHistory::Area area = getArea(configure ? applied : getConfig());
+
+        while (isThreadRunning()) {
+            if (configure && config_changed.exchange(false)) {
+                OFXXETHRU_TRACE_SCOPE("XepConfig::apply");
+                lock();
+                XepConfig wanted = config;
+                unlock();
+                if (wanted != applied) {
+                    if (wanted.apply(xep, applied)) {
+                        ofLogError("ofxXeThru") << "could not apply config to " << device_name;
+                    }
+                    // a new frame rate or area may restart the counter
+                    counting = false;
+                    area = getArea(applied);
+                }
+                last_frame = ofGetElapsedTimeMicros();
+            }
+            if (jobs_pending) {
+                runJobs(xep);
+                // no frames were read meanwhile, that's not a stall
+                last_frame = ofGetElapsedTimeMicros();
+            }
+            if (configure && ping_interval > 0 && ofGetElapsedTimeMicros() - last_ping >= ping_interval * 1e6f) {
+                ping(xep);
+                last_ping = ofGetElapsedTimeMicros();
+            }
+            const int queued = xep.peek_message_data_float();
+            module_queue_depth = std::max(queued, 0);
+            if (queued <= 0) {
+                if (ofGetElapsedTimeMicros() - meter.start >= 2000000) {
+                    // nothing for a while, don't keep showing the old rate
+                    throughput = 0;
+                    measured_fps = 0;
+                }
+                if (watch && stalled(xep, last_frame)) {
+                    return true;
+                }
+                sleep(1);
+                continue;
             }
-            std::cout << '\n';
+            // decode straight into the triple buffer's back slot, its
+            // vector keeps its capacity from one frame to the next
+            ofxXeThruFrame & frame = latest.getWriteBuffer();
+            {
+                // serial read, packet parse and decode, all inside ModuleConnector
+                OFXXETHRU_TRACE_SCOPE("XEP::read_message_data_float");
+                if (xep.read_message_data_float(&frame)) {
+                    ofLogError("ofxXeThru") << "read_message_data_float failed on " << device_name;
+                    if (watch && ++read_failures >= max_read_failures) {
+                        return true;
+                    }
+                    continue;
+                }
+            }
+            read_failures = 0;
+            frame.device_id = device_id;
+            frame.timestamp = ofGetElapsedTimeMicros();
+            last_frame = frame.timestamp;
+
+            measure(meter, frame);
+            handoff(frame, area);
+        }
+        return false;
+    }
+
+    // throughput, fps and CPU load of the acquisition thread, each second
+    struct Meter {
+        uint64_t start = 0;
+        size_t bytes = 0;
+        size_t frames = 0;
+        uint64_t cpu_start = 0;
+    };
+
+    void startMeter(Meter & meter){
+        meter = Meter();
+        meter.start = ofGetElapsedTimeMicros();
+        meter.cpu_start = getThreadCpuTime();
+    }
+
+    void measure(Meter & meter, const ofxXeThruFrame & frame){
+        meter.bytes += frame.data.size() * sizeof(float);
+        ++meter.frames;
+        if (frame.timestamp - meter.start >= 1000000) {
+            const float seconds = (frame.timestamp - meter.start) / 1e6f;
+            const uint64_t cpu = getThreadCpuTime();
+            throughput = meter.bytes / seconds;
+            measured_fps = meter.frames / seconds;
+            cpu_load = (cpu - meter.cpu_start) / 1e6f / seconds;
+            meter.start = frame.timestamp;
+            meter.bytes = 0;
+            meter.frames = 0;
+            meter.cpu_start = cpu;
         }
-        return 0;
     }
-};
 
+    static ofxXeThruFrameHistory::Area getArea(const XepConfig & shape){
+        ofxXeThruFrameHistory::Area area;
+        area.fa1 = shape.fa1;
+        area.fa2 = shape.fa2;
+        area.downconversion = shape.dc != 0;
+        return area;
+    }
+
+    // frame is latest's write buffer, read in and stamped
+    void handoff(ofxXeThruFrame & frame, const ofxXeThruFrameHistory::Area & area){
+        OFXXETHRU_TRACE_SCOPE("ofxXeThru handoff");
+        countGap(frame.info);
+        push(frame);
+        frame_signal.notify();
+        if (ofxXeThruRecorder * r = recorder) {
+            r->push(frame);
+        }
+        if (ofxXeThruPublisher * p = publisher) {
+            p->publish(frame);
+        }
+        if (!history.empty()) {
+            history.write(frame, area);
+        }
+        latest.publish();
+    }
+};
@@ -0,0 +1,78 @@
+//
+//  ofxXeThruBaudrate.h
+//  Connect-time serial rate negotiation. Steps up from the default rate
+//  through the XTID_BAUDRATE_* values, verifying every step with ping(),
+//  and falls back to the last rate that worked.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include "XEP.hpp"
+#include "xtid.h"
+
+#include <vector>
+
+class ofxXeThruBaudrate {
+
+public:
+
+    // modules come up at this rate after a reset
+    static const uint32_t default_rate = XTID_BAUDRATE_115200;
+
+    static const std::vector<uint32_t> & getRates(){
+        static const std::vector<uint32_t> rates = {
+            XTID_BAUDRATE_115200,
+            XTID_BAUDRATE_230400,
+            XTID_BAUDRATE_460800,
+            XTID_BAUDRATE_921600,
+            XTID_BAUDRATE_1000000,
+            XTID_BAUDRATE_2000000,
+            XTID_BAUDRATE_3000000,
+            XTID_BAUDRATE_4000000,
+        };
+        return rates;
+    }
+
+    // a couple of round trips with a sane pong, both ready and not ready
+    // answers prove the link works at this rate
+    static bool verify(XeThru::XEP & xep, int pings = 4){
+        for (int i = 0; i < pings; ++i) {
+            uint32_t pong = 0;
+            if (xep.ping(&pong)) {
+                return false;
+            }
+            if (pong != 0xaaeeaeea && pong != 0xaeeaeeaa) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Returns the rate the link settled on, never above max_rate. Stepping
+    // up means a failed step is always one rate above a known good one.
+    static uint32_t negotiate(XeThru::XEP & xep, uint32_t max_rate = XTID_BAUDRATE_4000000){
+        uint32_t settled = default_rate;
+        if (!verify(xep)) {
+            return 0;
+        }
+        for (uint32_t rate : getRates()) {
+            if (rate <= settled || rate > max_rate) {
+                continue;
+            }
+            if (xep.set_baudrate(rate) == 0 && verify(xep)) {
+                settled = rate;
+                continue;
+            }
+            // back to the last good rate and stop climbing
+            xep.set_baudrate(settled);
+            if (!verify(xep)) {
+                ofLogError("ofxXeThruBaudrate") << "lost the link falling back to " << settled;
+                return 0;
+            }
+            break;
+        }
+        return settled;
+    }
+};
@@ -0,0 +1,118 @@
+//
+//  ofxXeThruCodec.h
+//  Compression for frames x bins float matrices. Every bin is predicted
+//  from the same bin in the previous frame, which is where radar frames
+//  are most alike: lossless mode XORs the float bits, quantised mode
+//  rounds to a step and takes the integer difference. The residuals are
+//  split into byte planes, so the mostly zero high bytes line up, and
+//  entropy coded with deflate's run-length/Huffman strategy, which is much
+//  faster than a full LZ search.
+//
+//  Lossless suits noise floor data poorly since its low mantissa bits are
+//  random, a quantisation step at the ADC resolution is what gets 3-5x.
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <zlib.h>
+
+namespace ofxXeThruCodec {
+
+    static inline uint32_t zigzag(int32_t value){
+        return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+    }
+
+    static inline int32_t unzigzag(uint32_t value){
+        return int32_t(value >> 1) ^ -int32_t(value & 1);
+    }
+
+    // quantisation 0 is lossless, otherwise values are rounded to
+    // multiples of it. Returns false if deflate fails.
+    static bool encode(const float * matrix, size_t frames, size_t bins, float quantisation,
+                       std::vector<uint8_t> & out){
+        const size_t count = frames * bins;
+        if (count == 0) {
+            out.clear();
+            return true;
+        }
+        std::vector<uint8_t> planes(count * 4);
+        uint8_t * plane[4] = {&planes[0], &planes[count], &planes[2 * count], &planes[3 * count]};
+
+        const float scale = quantisation > 0 ? 1.0f / quantisation : 0;
+        std::vector<uint32_t> residual(count);
+        std::vector<uint32_t> previous(bins, 0);
+        for (size_t n = 0; n < count; n += bins) {
+            for (size_t b = 0; b < bins; ++b) {
+                uint32_t & last = previous[b];
+                uint32_t value;
+                if (quantisation > 0) {
+                    value = uint32_t(int32_t(std::lrint(matrix[n + b] * scale)));
+                    residual[n + b] = zigzag(int32_t(value - last));
+                } else {
+                    std::memcpy(&value, &matrix[n + b], sizeof(value));
+                    residual[n + b] = value ^ last;
+                }
+                last = value;
+            }
+        }
+        for (size_t n = 0; n < count; ++n) {
+            plane[0][n] = uint8_t(residual[n]);
+            plane[1][n] = uint8_t(residual[n] >> 8);
+            plane[2][n] = uint8_t(residual[n] >> 16);
+            plane[3][n] = uint8_t(residual[n] >> 24);
+        }
+
+        uLongf length = compressBound(planes.size());
+        out.resize(length);
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (deflateInit2(&stream, 1, Z_DEFLATED, 15, 8, Z_RLE) != Z_OK) {
+            return false;
+        }
+        stream.next_in = planes.data();
+        stream.avail_in = planes.size();
+        stream.next_out = out.data();
+        stream.avail_out = out.size();
+        const bool ok = deflate(&stream, Z_FINISH) == Z_STREAM_END;
+        out.resize(stream.total_out);
+        deflateEnd(&stream);
+        return ok;
+    }
+
+    // matrix must hold frames * bins floats
+    static bool decode(const uint8_t * data, size_t size, size_t frames, size_t bins, float quantisation,
+                       float * matrix){
+        const size_t count = frames * bins;
+        if (count == 0) {
+            return true;
+        }
+        std::vector<uint8_t> planes(count * 4);
+        uLongf length = planes.size();
+        if (uncompress(planes.data(), &length, data, size) != Z_OK || length != planes.size()) {
+            return false;
+        }
+        const uint8_t * plane[4] = {&planes[0], &planes[count], &planes[2 * count], &planes[3 * count]};
+
+        std::vector<uint32_t> previous(bins, 0);
+        for (size_t n = 0; n < count; n += bins) {
+            for (size_t b = 0; b < bins; ++b) {
+                const size_t k = n + b;
+                const uint32_t residual = plane[0][k] | plane[1][k] << 8 | plane[2][k] << 16 | uint32_t(plane[3][k]) << 24;
+                uint32_t & last = previous[b];
+                if (quantisation > 0) {
+                    last += uint32_t(unzigzag(residual));
+                    matrix[k] = int32_t(last) * quantisation;
+                } else {
+                    last ^= residual;
+                    std::memcpy(&matrix[k], &last, sizeof(last));
+                }
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,603 @@
+//
+//  ofxXeThruColumnar.h
+//  Columnar export of recordings for analysis tools. Baseband and float
+//  frames are transcoded, through DataReader, into chunk files that hold a
+//  frame counter column, an epoch column and one frames x bins float32
+//  matrix per signal (amplitude and phase, i and q, or the float data).
+//  Uncompressed columns start on 64 byte boundaries, so a chunk can be
+//  loaded with a single mmap or numpy.memmap, no per-record calls.
+//
+//  output/
+//    index.csv                 one line per chunk: type, file, frames, bins, epochs
+//    baseband_ap/000000.xtc
+//    baseband_iq/000000.xtc
+//    float/000000.xtc
+//
+//  All values are little endian, as written by the host.
+//
+//  Recorder writes the same chunks live: hooked up with setRecorder() on a
+//  sensor it takes the frames off the acquisition thread, and the encoding
+//  and compression run on its writer thread. ofxXeThru::setupPlayback()
+//  plays the float chunks of a directory back, decompressed on the way.
+//
+
+#pragma once
+
+#include "ofxXeThruRecord.h"
+#include "ofxXeThruRecorder.h"
+#include "ofxXeThruReplay.h"
+#include "ofxXeThruCodec.h"
+#include "ofxXeThruDecoders.h"
+
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace ofxXeThruColumnar {
+
+    enum Compression : uint32_t {
+        // columns are mmapped as is
+        CompressionNone = 0,
+        // deflate per column, the chunk is inflated once on open
+        CompressionZlib = 1,
+        // ofxXeThruCodec on the matrices, deflate on the index columns
+        CompressionDelta = 2,
+    };
+
+    // the data types chunks can hold
+    static const uint32_t chunk_types = XeThru::BasebandApDataType | XeThru::BasebandIqDataType | XeThru::FloatDataType;
+
+    // frame_counter, epoch and up to two matrices
+    static const size_t max_columns = 4;
+    static const size_t column_alignment = 64;
+
+    struct Column {
+        uint64_t offset = 0;
+        uint64_t stored_size = 0;
+        uint64_t size = 0;
+    };
+
+    // fixed size so the first column always starts at the same place
+    struct ChunkHeader {
+        char magic[4] = {'X', 'T', 'C', 'C'};
+        uint32_t version = 1;
+        uint32_t data_type = XeThru::InvalidDataType;
+        uint32_t compression = CompressionNone;
+        uint32_t frames = 0;
+        uint32_t bins = 0;
+        // float matrices that follow the two index columns
+        uint32_t matrices = 0;
+        // CompressionDelta step, 0 is lossless
+        float quantisation = 0;
+        // baseband only, 0 for float data
+        float bin_length = 0;
+        float sample_frequency = 0;
+        float carrier_frequency = 0;
+        float range_offset = 0;
+        int64_t first_epoch = 0;
+        int64_t last_epoch = 0;
+        Column columns[max_columns];
+    };
+
+    // one decoded record, pointers into the record bytes
+    struct Frame {
+        uint32_t frame_counter = 0;
+        uint32_t bins = 0;
+        uint32_t matrices = 0;
+        float bin_length = 0;
+        float sample_frequency = 0;
+        float carrier_frequency = 0;
+        float range_offset = 0;
+        const uint8_t * matrix[2] = {nullptr, nullptr};
+    };
+
+    static const char * getTypeName(uint32_t data_type){
+        switch (data_type) {
+            case XeThru::BasebandApDataType: return "baseband_ap";
+            case XeThru::BasebandIqDataType: return "baseband_iq";
+            case XeThru::FloatDataType: return "float";
+            default: return nullptr;
+        }
+    }
+
+    template<uint32_t Type>
+    static bool decodeBaseband(const ofxXeThruRecord & record, Frame & frame){
+        typedef ofxXeThruDecoders::Decoder<Type> Decoder;
+        // vectors stay empty, nothing is allocated
+        typename Decoder::Data header;
+        if (!Decoder::decodeHeader(record.data, record.size, header)) {
+            return false;
+        }
+        frame.frame_counter = header.frame_counter;
+        frame.bins = header.num_bins;
+        frame.bin_length = header.bin_length;
+        frame.sample_frequency = header.sample_frequency;
+        frame.carrier_frequency = header.carrier_frequency;
+        frame.range_offset = header.range_offset;
+        frame.matrices = Decoder::matrices;
+        frame.matrix[0] = record.data + Decoder::header_size;
+        frame.matrix[1] = frame.matrix[0] + frame.bins * sizeof(float);
+        return true;
+    }
+
+    // Record layouts are in ofxXeThruDecoders.h, only the fixed fields are
+    // decoded here, the matrices are left where they are in the record
+    static bool decode(const ofxXeThruRecord & record, Frame & frame){
+        if (record.is_user_header) {
+            return false;
+        }
+        switch (record.data_type) {
+            case XeThru::BasebandApDataType: return decodeBaseband<XeThru::BasebandApDataType>(record, frame);
+            case XeThru::BasebandIqDataType: return decodeBaseband<XeThru::BasebandIqDataType>(record, frame);
+            case XeThru::FloatDataType: {
+                typedef ofxXeThruDecoders::Decoder<XeThru::FloatDataType> Decoder;
+                XeThru::DataFloat header;
+                if (!Decoder::decodeHeader(record.data, record.size, header)) {
+                    return false;
+                }
+                frame = Frame();
+                frame.frame_counter = header.info;
+                ofxXeThruDecoders::unpack(record.data + 8, 1, &frame.bins);
+                frame.matrices = Decoder::matrices;
+                frame.matrix[0] = record.data + Decoder::header_size;
+                return true;
+            }
+            default: return false;
+        }
+    }
+
+    //--------------------------------------------------------------
+    // Collects frames per data type and writes a chunk every chunk_frames
+    // frames, or earlier when the bin count or the frame area changes so a
+    // chunk is always one rectangular matrix.
+    class Writer {
+
+    public:
+
+        ~Writer(){
+            close();
+        }
+
+        // quantisation only applies to CompressionDelta
+        int open(const std::string & _directory, uint32_t _chunk_frames = 4096,
+                 Compression _compression = CompressionNone, float _quantisation = 0){
+            close();
+            directory = _directory;
+            chunk_frames = _chunk_frames ? _chunk_frames : 1;
+            compression = _compression;
+            quantisation = _compression == CompressionDelta ? _quantisation : 0;
+            if (!makeDirectory(directory)) {
+                return 1;
+            }
+            index = std::fopen((directory + "/index.csv").c_str(), "w");
+            if (index == nullptr) {
+                return 1;
+            }
+            std::fprintf(index, "type,file,frames,bins,first_epoch,last_epoch\n");
+            for (size_t t = 0; t < type_count; ++t) {
+                streams[t] = Stream();
+            }
+            frames = 0;
+            return 0;
+        }
+
+        bool is_open() const {
+            return index != nullptr;
+        }
+
+        // frames added since open
+        uint64_t getFrameCount() const {
+            return frames;
+        }
+
+        // records of other data types are skipped, returns 1 on a write error
+        int add(const ofxXeThruRecord & record){
+            Frame frame;
+            Stream * stream = getStream(record.data_type);
+            if (!is_open() || stream == nullptr || !decode(record, frame)) {
+                return 0;
+            }
+            ChunkHeader & header = stream->header;
+            const bool reshaped = header.frames > 0 &&
+                (frame.bins != header.bins ||
+                 frame.bin_length != header.bin_length ||
+                 frame.range_offset != header.range_offset);
+            if (reshaped && flush(*stream)) {
+                return 1;
+            }
+            if (header.frames == 0) {
+                header.data_type = record.data_type;
+                header.bins = frame.bins;
+                header.matrices = frame.matrices;
+                header.bin_length = frame.bin_length;
+                header.sample_frequency = frame.sample_frequency;
+                header.carrier_frequency = frame.carrier_frequency;
+                header.range_offset = frame.range_offset;
+                header.first_epoch = record.epoch;
+                const size_t reserve = size_t(chunk_frames) * frame.bins;
+                for (uint32_t m = 0; m < frame.matrices; ++m) {
+                    stream->matrix[m].reserve(reserve);
+                }
+                stream->frame_counters.reserve(chunk_frames);
+                stream->epochs.reserve(chunk_frames);
+            }
+            stream->frame_counters.push_back(frame.frame_counter);
+            stream->epochs.push_back(record.epoch);
+            for (uint32_t m = 0; m < frame.matrices; ++m) {
+                std::vector<float> & matrix = stream->matrix[m];
+                const size_t end = matrix.size();
+                matrix.resize(end + frame.bins);
+                std::memcpy(&matrix[end], frame.matrix[m], frame.bins * sizeof(float));
+            }
+            header.last_epoch = record.epoch;
+            ++frames;
+            if (++header.frames == chunk_frames) {
+                return flush(*stream);
+            }
+            return 0;
+        }
+
+        // writes the partial chunks, returns 1 if any write failed
+        int close(){
+            int failed = 0;
+            if (index != nullptr) {
+                for (size_t t = 0; t < type_count; ++t) {
+                    if (streams[t].header.frames > 0) {
+                        failed |= flush(streams[t]);
+                    }
+                }
+                failed |= std::fclose(index) != 0;
+                index = nullptr;
+            }
+            return failed;
+        }
+
+    private:
+
+        static const size_t type_count = 3;
+
+        struct Stream {
+            ChunkHeader header;
+            uint32_t chunk = 0;
+            std::vector<uint32_t> frame_counters;
+            std::vector<int64_t> epochs;
+            std::vector<float> matrix[2];
+        };
+
+        Stream * getStream(uint32_t data_type){
+            switch (data_type) {
+                case XeThru::BasebandApDataType: return &streams[0];
+                case XeThru::BasebandIqDataType: return &streams[1];
+                case XeThru::FloatDataType: return &streams[2];
+                default: return nullptr;
+            }
+        }
+
+        static bool makeDirectory(const std::string & path){
+            return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+        }
+
+        int flush(Stream & stream){
+            ChunkHeader & header = stream.header;
+            const std::string folder = directory + "/" + getTypeName(header.data_type);
+            char name[16];
+            std::snprintf(name, sizeof(name), "%06u.xtc", stream.chunk++);
+            const std::string relative = std::string(getTypeName(header.data_type)) + "/" + name;
+
+            const void * sources[max_columns] = {
+                stream.frame_counters.data(), stream.epochs.data(),
+                stream.matrix[0].data(), stream.matrix[1].data()
+            };
+            const size_t sizes[max_columns] = {
+                stream.frame_counters.size() * sizeof(uint32_t),
+                stream.epochs.size() * sizeof(int64_t),
+                stream.matrix[0].size() * sizeof(float),
+                stream.matrix[1].size() * sizeof(float)
+            };
+            const size_t columns = 2 + header.matrices;
+            header.compression = compression;
+            header.quantisation = quantisation;
+
+            bool ok = makeDirectory(folder);
+            FILE * file = ok ? std::fopen((folder + "/" + name).c_str(), "wb") : nullptr;
+            ok = file != nullptr;
+            if (ok) {
+                // header is rewritten once the column sizes are known
+                ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+                uint64_t offset = sizeof(header);
+                const uint8_t padding[column_alignment] = {};
+                for (size_t c = 0; ok && c < columns; ++c) {
+                    const size_t pad = (column_alignment - offset % column_alignment) % column_alignment;
+                    ok = std::fwrite(padding, 1, pad, file) == pad;
+                    offset += pad;
+
+                    const uint8_t * bytes = static_cast<const uint8_t *>(sources[c]);
+                    size_t stored = sizes[c];
+                    if (compression == CompressionDelta && c >= 2) {
+                        ok = ok && ofxXeThruCodec::encode(stream.matrix[c - 2].data(), header.frames, header.bins,
+                                                          quantisation, scratch);
+                        bytes = scratch.data();
+                        stored = scratch.size();
+                    } else if (compression != CompressionNone) {
+                        uLongf length = compressBound(sizes[c]);
+                        scratch.resize(length);
+                        ok = ok && compress2(scratch.data(), &length, bytes, sizes[c], Z_DEFAULT_COMPRESSION) == Z_OK;
+                        bytes = scratch.data();
+                        stored = length;
+                    }
+                    ok = ok && std::fwrite(bytes, 1, stored, file) == stored;
+                    header.columns[c].offset = offset;
+                    header.columns[c].stored_size = stored;
+                    header.columns[c].size = sizes[c];
+                    offset += stored;
+                }
+                ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+                ok = std::fclose(file) == 0 && ok;
+            }
+            if (ok) {
+                std::fprintf(index, "%s,%s,%u,%u,%lld,%lld\n", getTypeName(header.data_type), relative.c_str(),
+                             header.frames, header.bins, (long long)header.first_epoch, (long long)header.last_epoch);
+            }
+
+            // keeps the vectors' capacity for the next chunk
+            const uint32_t data_type = header.data_type;
+            header = ChunkHeader();
+            header.data_type = data_type;
+            stream.frame_counters.clear();
+            stream.epochs.clear();
+            stream.matrix[0].clear();
+            stream.matrix[1].clear();
+            return ok ? 0 : 1;
+        }
+
+        std::string directory;
+        uint32_t chunk_frames = 4096;
+        Compression compression = CompressionNone;
+        float quantisation = 0;
+        FILE * index = nullptr;
+        uint64_t frames = 0;
+        Stream streams[type_count];
+        std::vector<Bytef> scratch;
+    };
+
+    //--------------------------------------------------------------
+    // Live recording into chunk files, the frames are queued on
+    // ofxXeThruRecorder's bounded queue and the writer thread adds them
+    // to a Writer. Set it on a sensor with setRecorder() like any
+    // recorder. Records are stamped with the time they were queued.
+    class Recorder : public ofxXeThruRecorder {
+
+    public:
+
+        ~Recorder(){
+            stop();
+        }
+
+        // data_types is masked to the types the format holds
+        int start(const std::string & directory, uint32_t data_types = XeThru::FloatDataType,
+                  uint32_t chunk_frames = 4096, Compression compression = CompressionDelta, float quantisation = 0,
+                  size_t queue_size = 512, size_t record_size = 64 * 1024){
+            stop();
+            if (writer.open(directory, chunk_frames, compression, quantisation)) {
+                ofLogError("ofxXeThruColumnar") << "could not start recording to " << directory;
+                return 1;
+            }
+            startWriter(XeThru::DataTypes(data_types & chunk_types), queue_size, record_size);
+            return 0;
+        }
+
+    protected:
+
+        bool write(const Record & record) override {
+            ofxXeThruRecord view;
+            view.data = record.bytes.data();
+            view.size = record.bytes.size();
+            view.data_type = record.data_type;
+            view.epoch = record.epoch;
+            return writer.add(view) == 0;
+        }
+
+        void finish() override {
+            if (writer.close()) {
+                ofLogError("ofxXeThruColumnar") << "could not write the last chunks";
+            }
+        }
+
+    private:
+
+        Writer writer;
+    };
+
+    //--------------------------------------------------------------
+    // Chunk files of data_type listed in directory/index.csv, in the order
+    // they were written. 1 when there is no index.
+    static int readIndex(const std::string & directory, uint32_t data_type, std::vector<std::string> & files){
+        files.clear();
+        const char * type = getTypeName(data_type);
+        FILE * index = std::fopen((directory + "/index.csv").c_str(), "r");
+        if (index == nullptr || type == nullptr) {
+            if (index != nullptr) {
+                std::fclose(index);
+            }
+            return 1;
+        }
+        char line[512];
+        // the first line is the column names
+        bool names = true;
+        while (std::fgets(line, sizeof(line), index) != nullptr) {
+            char * file = std::strchr(line, ',');
+            if (names || file == nullptr) {
+                names = false;
+                continue;
+            }
+            *file++ = 0;
+            char * end = std::strchr(file, ',');
+            if (end == nullptr || std::strcmp(line, type) != 0) {
+                continue;
+            }
+            *end = 0;
+            files.push_back(directory + "/" + file);
+        }
+        std::fclose(index);
+        return 0;
+    }
+
+    //--------------------------------------------------------------
+    // One chunk. Uncompressed chunks are read straight from the mapping,
+    // compressed ones are decoded once into memory owned by the reader.
+    class Chunk {
+
+    public:
+
+        ~Chunk(){
+            close();
+        }
+
+        int open(const std::string & filename){
+            close();
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return 1;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(ChunkHeader)) {
+                ::close(fd);
+                return 1;
+            }
+            void * address = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (address == MAP_FAILED) {
+                return 1;
+            }
+            mapping = address;
+            mapping_size = info.st_size;
+            header = static_cast<const ChunkHeader *>(mapping);
+            if (std::memcmp(header->magic, "XTCC", 4) != 0 || header->version != 1 || header->matrices > 2) {
+                close();
+                return 1;
+            }
+
+            const uint8_t * base = static_cast<const uint8_t *>(mapping);
+            for (size_t c = 0; c < 2 + header->matrices; ++c) {
+                const Column & column = header->columns[c];
+                // frame counters, epochs, then frames x bins floats
+                const uint64_t width = c == 0 ? sizeof(uint32_t) : c == 1 ? sizeof(int64_t) : uint64_t(header->bins) * sizeof(float);
+                const bool sized = column.size == header->frames * width &&
+                    (header->compression != CompressionNone || column.stored_size == column.size);
+                if (!sized || column.offset > mapping_size || column.stored_size > mapping_size - column.offset) {
+                    close();
+                    return 1;
+                }
+                if (header->compression == CompressionNone) {
+                    columns[c] = base + column.offset;
+                    continue;
+                }
+                if (header->compression != CompressionZlib && header->compression != CompressionDelta) {
+                    close();
+                    return 1;
+                }
+                inflated[c].resize(column.size);
+                bool ok;
+                if (header->compression == CompressionDelta && c >= 2) {
+                    ok = ofxXeThruCodec::decode(base + column.offset, column.stored_size, header->frames, header->bins,
+                                                header->quantisation, reinterpret_cast<float *>(inflated[c].data()));
+                } else {
+                    uLongf length = column.size;
+                    ok = uncompress(inflated[c].data(), &length, base + column.offset, column.stored_size) == Z_OK &&
+                        length == column.size;
+                }
+                if (!ok) {
+                    close();
+                    return 1;
+                }
+                columns[c] = inflated[c].data();
+            }
+            return 0;
+        }
+
+        bool is_open() const {
+            return mapping != nullptr;
+        }
+
+        void close(){
+            if (mapping != nullptr) {
+                munmap(mapping, mapping_size);
+            }
+            mapping = nullptr;
+            mapping_size = 0;
+            header = nullptr;
+            for (size_t c = 0; c < max_columns; ++c) {
+                columns[c] = nullptr;
+                inflated[c].clear();
+            }
+        }
+
+        const ChunkHeader & getHeader() const {
+            return *header;
+        }
+
+        uint32_t getFrames() const {
+            return header->frames;
+        }
+
+        uint32_t getBins() const {
+            return header->bins;
+        }
+
+        const uint32_t * getFrameCounters() const {
+            return reinterpret_cast<const uint32_t *>(columns[0]);
+        }
+
+        const int64_t * getEpochs() const {
+            return reinterpret_cast<const int64_t *>(columns[1]);
+        }
+
+        // frames x bins, row-major: amplitude/phase, i/q, or the float data
+        const float * getMatrix(size_t m) const {
+            return m < header->matrices ? reinterpret_cast<const float *>(columns[2 + m]) : nullptr;
+        }
+
+        const float * getRow(size_t m, size_t frame) const {
+            return getMatrix(m) + frame * header->bins;
+        }
+
+    private:
+
+        void * mapping = nullptr;
+        size_t mapping_size = 0;
+        const ChunkHeader * header = nullptr;
+        const uint8_t * columns[max_columns] = {};
+        std::vector<uint8_t> inflated[max_columns];
+    };
+
+    //--------------------------------------------------------------
+    // Whole recording, unpaced. data_types is masked to the types the format
+    // holds. Returns the number of frames written, or -1 on error.
+    static int64_t transcode(const std::string & meta_filename, const std::string & directory,
+                             uint32_t data_types = XeThru::BasebandApDataType | XeThru::BasebandIqDataType | XeThru::FloatDataType,
+                             uint32_t chunk_frames = 4096, Compression compression = CompressionNone,
+                             float quantisation = 0){
+        Writer writer;
+        if (writer.open(directory, chunk_frames, compression, quantisation)) {
+            return -1;
+        }
+        data_types &= chunk_types;
+        bool ok = true;
+        const int64_t records = ofxXeThruReplay::run(meta_filename, data_types,
+            [&](const ofxXeThruRecord & record, size_t){
+                ok = writer.add(record) == 0;
+                return ok;
+            });
+        const int64_t frames = writer.getFrameCount();
+        ok = writer.close() == 0 && ok;
+        return records < 0 || !ok ? -1 : frames;
+    }
+}
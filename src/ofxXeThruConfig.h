@@ -0,0 +1,100 @@
+//
+//  ofxXeThruConfig.h
+//  X4 driver settings that ofxXeThru sends to a module, applied as a diff
+//  against the last state the module acknowledged.
+//
+
+#pragma once
+
+#include "XEP.hpp"
+
+struct XepConfig {
+
+    int dac_min = 949;
+    int dac_max = 1100;
+    int iteration = 32;
+    int pps = 150;
+    int fps = 17;
+    float offset = 0.18;
+    float fa1 = 0.4;
+    float fa2 = 5.0;
+    int dc = 0;
+
+    bool operator==(const XepConfig & other) const {
+        return dac_min == other.dac_min && dac_max == other.dac_max &&
+            iteration == other.iteration && pps == other.pps &&
+            fps == other.fps && offset == other.offset &&
+            fa1 == other.fa1 && fa2 == other.fa2 && dc == other.dc;
+    }
+
+    bool operator!=(const XepConfig & other) const {
+        return !(*this == other);
+    }
+
+    // a state that matches nothing, e.g. right after x4driver_init()
+    static XepConfig unknown(){
+        XepConfig state;
+        state.dac_min = state.dac_max = state.iteration = state.pps = -1;
+        state.fps = state.dc = -1;
+        state.offset = state.fa1 = state.fa2 = -1;
+        return state;
+    }
+
+    // Sends only the settings that differ from last, the state the module
+    // is known to be in. Streaming is paused while the frame is reshaped so
+    // no half-configured frame goes out. last is updated field by field as
+    // each command is acknowledged, so a failed apply can simply be retried.
+    // Returns the number of failed commands.
+    int apply(XeThru::XEP & xep, XepConfig & last) const {
+        int failed = 0;
+        const bool reshape = offset != last.offset || fa1 != last.fa1 ||
+            fa2 != last.fa2 || dc != last.dc;
+        const bool pause = reshape && last.fps > 0;
+
+        if (pause) {
+            if (xep.x4driver_set_fps(0)) {
+                ++failed;
+            } else {
+                last.fps = 0;
+            }
+        }
+        if (dac_min != last.dac_min) {
+            if (xep.x4driver_set_dac_min(dac_min)) ++failed; else last.dac_min = dac_min;
+        }
+        if (dac_max != last.dac_max) {
+            if (xep.x4driver_set_dac_max(dac_max)) ++failed; else last.dac_max = dac_max;
+        }
+        if (iteration != last.iteration) {
+            if (xep.x4driver_set_iterations(iteration)) ++failed; else last.iteration = iteration;
+        }
+        if (pps != last.pps) {
+            if (xep.x4driver_set_pulses_per_step(pps)) ++failed; else last.pps = pps;
+        }
+        // the area is measured from the offset, so a new offset means
+        // the area has to be sent again as well
+        if (offset != last.offset) {
+            if (xep.x4driver_set_frame_area_offset(offset)) {
+                ++failed;
+            } else {
+                last.offset = offset;
+                last.fa1 = last.fa2 = -1;
+            }
+        }
+        if (fa1 != last.fa1 || fa2 != last.fa2) {
+            if (xep.x4driver_set_frame_area(fa1, fa2)) {
+                ++failed;
+            } else {
+                last.fa1 = fa1;
+                last.fa2 = fa2;
+            }
+        }
+        if (dc != last.dc) {
+            if (xep.x4driver_set_downconversion(dc)) ++failed; else last.dc = dc;
+        }
+        // fps goes last, it starts the stream
+        if (fps != last.fps) {
+            if (xep.x4driver_set_fps(fps)) ++failed; else last.fps = fps;
+        }
+        return failed;
+    }
+};
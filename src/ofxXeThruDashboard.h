@@ -0,0 +1,185 @@
+//
+//  ofxXeThruDashboard.h
+//  Text overlay of how every sensor and pipeline stage is keeping up:
+//  received vs configured fps, handoff latency percentiles, the
+//  ModuleConnector and frame queue depths, frames dropped and lost,
+//  throughput against the baud rate and acquisition thread CPU. Rows
+//  that fall behind are drawn red with the reason, so the bottleneck
+//  shows without a profiler.
+//
+//  Everything is read from the sensors' atomic counters and histograms,
+//  never from a lock the acquisition thread takes. update() samples once
+//  per interval and works out rates and percentiles over that interval.
+//  Built with OFXXETHRU_TRACE the per stage times of ofxXeThruTrace are
+//  listed too, the stage taking the most time marked.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include "ofxXeThru.h"
+#include "ofxXeThruManager.h"
+#include "ofxXeThruHistogram.h"
+#include "ofxXeThruTrace.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class ofxXeThruDashboard {
+
+public:
+
+    struct Row {
+        int device_id = 0;
+        bool connected = false;
+        float fps = 0;
+        int configured_fps = 0;
+        // microseconds, over the last interval
+        uint64_t latency_p50 = 0;
+        uint64_t latency_p99 = 0;
+        uint64_t latency_max = 0;
+        int module_queue = 0;
+        size_t queue = 0;
+        // over the last interval
+        uint64_t dropped = 0;
+        uint64_t missing = 0;
+        float throughput = 0;
+        uint32_t baudrate = 0;
+        float cpu = 0;
+        // empty when keeping up, else what is behind
+        std::string warning;
+    };
+
+    void add(ofxXeThru & sensor){
+        sensors.push_back(Sensor());
+        sensors.back().sensor = &sensor;
+    }
+
+    void setup(ofxXeThruManager & manager){
+        sensors.clear();
+        for (size_t i = 0; i < manager.size(); ++i) {
+            add(manager.getSensor(i));
+        }
+    }
+
+    void setInterval(float seconds){
+        interval = seconds;
+    }
+
+    // call every frame, samples once per interval
+    void update(){
+        const float now = ofGetElapsedTimef();
+        if (now - last_update < interval && !rows.empty()) {
+            return;
+        }
+        last_update = now;
+        rows.resize(sensors.size());
+        for (size_t s = 0; s < sensors.size(); ++s) {
+            sample(sensors[s], rows[s]);
+        }
+#ifdef OFXXETHRU_TRACE
+        stages = ofxXeThruTrace::getSummary();
+#endif
+    }
+
+    const std::vector<Row> & getRows() const {
+        return rows;
+    }
+
+    void draw(float x, float y){
+        const float line = 14;
+        char text[256];
+        std::snprintf(text, sizeof(text), "%-4s %13s %17s %9s %11s %15s %4s", "dev", "fps", "latency ms 50/99/max",
+            "queue mc/q", "drop/lost", "kB/s of baud", "cpu");
+        ofDrawBitmapStringHighlight(text, x, y, background, ofColor::white);
+        for (const Row & row : rows) {
+            y += line;
+            std::snprintf(text, sizeof(text), "%-4d %6.1f / %-4d %5.1f %5.1f %5.1f %4d / %-4d %5llu / %-5llu %6.1f / %-6.1f %3.0f%%  %s",
+                row.device_id, row.fps, row.configured_fps, row.latency_p50 / 1e3, row.latency_p99 / 1e3, row.latency_max / 1e3,
+                row.module_queue, int(row.queue), (unsigned long long)row.dropped, (unsigned long long)row.missing,
+                row.throughput / 1e3, row.baudrate / 10 / 1e3, row.cpu * 100, row.connected ? row.warning.c_str() : "not connected");
+            ofDrawBitmapStringHighlight(text, x, y, background, row.warning.empty() && row.connected ? ofColor::white : warning);
+        }
+        if (stages.empty()) {
+            return;
+        }
+        // the stage with the most time in it is where to look first
+        size_t busiest = 0;
+        for (size_t i = 0; i < stages.size(); ++i) {
+            if (stages[i].p50 * stages[i].count > stages[busiest].p50 * stages[busiest].count) {
+                busiest = i;
+            }
+        }
+        y += 2 * line;
+        std::snprintf(text, sizeof(text), "%-28s %8s %9s %9s %9s", "stage", "count", "p50 us", "p99 us", "max us");
+        ofDrawBitmapStringHighlight(text, x, y, background, ofColor::white);
+        for (size_t i = 0; i < stages.size(); ++i) {
+            y += line;
+            const ofxXeThruTrace::Stage & stage = stages[i];
+            std::snprintf(text, sizeof(text), "%-28.28s %8zu %9.1f %9.1f %9.1f%s", stage.name.c_str(), stage.count,
+                stage.p50, stage.p99, stage.max, i == busiest ? "  <" : "");
+            ofDrawBitmapStringHighlight(text, x, y, background, i == busiest ? warning : ofColor::white);
+        }
+    }
+
+private:
+
+    struct Sensor {
+        ofxXeThru * sensor = nullptr;
+        ofxXeThruHistogram::Snapshot latency{};
+        uint64_t dropped = 0;
+        uint64_t missing = 0;
+    };
+
+    void sample(Sensor & state, Row & row){
+        ofxXeThru & sensor = *state.sensor;
+        row.device_id = sensor.getDeviceID();
+        row.connected = sensor.isConnected();
+        row.fps = sensor.getFps();
+        row.configured_fps = sensor.getConfiguredFps();
+
+        ofxXeThruHistogram::Snapshot latency;
+        sensor.getLatency().read(latency);
+        row.latency_p50 = ofxXeThruHistogram::getPercentile(latency, state.latency, 0.5);
+        row.latency_p99 = ofxXeThruHistogram::getPercentile(latency, state.latency, 0.99);
+        row.latency_max = ofxXeThruHistogram::getPercentile(latency, state.latency, 1.0);
+        state.latency = latency;
+
+        row.module_queue = sensor.getModuleQueueDepth();
+        row.queue = sensor.getQueueDepth();
+        const uint64_t dropped = sensor.getDroppedFrames();
+        const uint64_t missing = sensor.getMissingFrames();
+        row.dropped = dropped - state.dropped;
+        row.missing = missing - state.missing;
+        state.dropped = dropped;
+        state.missing = missing;
+        row.throughput = sensor.getThroughput();
+        row.baudrate = sensor.getBaudrate();
+        row.cpu = sensor.getCpuLoad();
+
+        // most upstream first, a slow link also shows as slow fps
+        row.warning.clear();
+        if (row.missing > 0) {
+            row.warning = "losing frames on the link";
+        } else if (row.baudrate > 0 && row.throughput > 0.9f * row.baudrate / 10) {
+            row.warning = "link saturated";
+        } else if (row.cpu > 0.9f || row.module_queue > 1) {
+            row.warning = "acquisition behind";
+        } else if (row.dropped > 0) {
+            row.warning = "consumer behind";
+        } else if (row.configured_fps > 0 && row.fps < 0.9f * row.configured_fps) {
+            row.warning = "below configured fps";
+        }
+    }
+
+    std::vector<Sensor> sensors;
+    std::vector<Row> rows;
+    std::vector<ofxXeThruTrace::Stage> stages;
+    float interval = 1;
+    float last_update = 0;
+
+    const ofColor background = ofColor(0, 0, 0, 180);
+    const ofColor warning = ofColor(255, 80, 60);
+};
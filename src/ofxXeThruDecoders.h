@@ -0,0 +1,340 @@
+//
+//  ofxXeThruDecoders.h
+//  Record decoders picked at compile time by DataType. Each Decoder<T>
+//  knows the record layout of its type, decodes straight into the
+//  ModuleConnector struct's vectors and encodes back for DataRecorder.
+//  There is no per record branching on type or size beyond the one
+//  length check, and the payload is one memcpy on little endian hosts,
+//  or a fixed length loop when the bin count is a template argument.
+//
+//  Record layouts are from the XeThru File Formats document:
+//    baseband      frame_counter, num_bins, bin_length, sample_frequency,
+//                  carrier_frequency, range_offset, then num_bins floats
+//                  of amplitude and phase, or of i and q
+//    float         content_id, info (frame counter), length, length floats
+//
+//  Pulse-Doppler and noise map records are taken to hold the fields of
+//  PulseDopplerFloatData / PulseDopplerByteData in declaration order, then
+//  frequency_count floats or bytes. That layout has not been checked
+//  against a recording made by a module, so those types are decode only:
+//  nothing here writes them into DataRecorder files where DataReader and
+//  the vendor tools would trust them. Everything is little endian.
+//
+
+#pragma once
+
+#include "Data.hpp"
+#include "datatypes.h"
+
+#include "ofxXeThruRecord.h"
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace ofxXeThruDecoders {
+
+    static inline bool isLittleEndian(){
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+        return __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+#else
+        const uint32_t probe = 1;
+        uint8_t first;
+        std::memcpy(&first, &probe, 1);
+        return first == 1;
+#endif
+    }
+
+    static inline uint32_t swap32(uint32_t value){
+        return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+    }
+
+    // count little endian 32 bit words, floats or integers
+    template<typename T>
+    static inline void unpack(const uint8_t * source, size_t count, T * destination){
+        static_assert(sizeof(T) == 4, "32 bit words only");
+        std::memcpy(destination, source, count * 4);
+        if (!isLittleEndian()) {
+            uint32_t * words = reinterpret_cast<uint32_t *>(destination);
+            for (size_t n = 0; n < count; ++n) {
+                words[n] = swap32(words[n]);
+            }
+        }
+    }
+
+    // fixed count, the compiler unrolls and vectorises the copy
+    template<size_t Count, typename T>
+    static inline void unpack(const uint8_t * source, T * destination){
+        unpack(source, Count, destination);
+    }
+
+    template<typename T>
+    static inline void pack(const T * source, size_t count, uint8_t * destination){
+        static_assert(sizeof(T) == 4, "32 bit words only");
+        std::memcpy(destination, source, count * 4);
+        if (!isLittleEndian()) {
+            for (size_t n = 0; n < count; ++n) {
+                uint32_t word;
+                std::memcpy(&word, destination + 4 * n, 4);
+                word = swap32(word);
+                std::memcpy(destination + 4 * n, &word, 4);
+            }
+        }
+    }
+
+    // byte_step_start + byte_step_size * byte, dB
+    static inline void dequantise(const uint8_t * source, size_t count, float start, float step, float * destination){
+        for (size_t n = 0; n < count; ++n) {
+            destination[n] = start + step * float(source[n]);
+        }
+    }
+
+    static inline void dequantise(const XeThru::PulseDopplerByteData & message, float * destination){
+        dequantise(message.data.data(), message.data.size(), message.byte_step_start, message.byte_step_size, destination);
+    }
+
+    // Bins = 0 takes the bin count from the record, anything else only
+    // accepts records of exactly Bins bins
+    template<uint32_t Type, size_t Bins = 0>
+    struct Decoder;
+
+    //--------------------------------------------------------------
+    // shared by both baseband types, a and b are amplitude and phase or
+    // i and q
+    template<typename Message, std::vector<float> Message::*A, std::vector<float> Message::*B, size_t Bins>
+    struct BasebandDecoder {
+        typedef Message Data;
+        static const size_t header_size = 6 * 4;
+        static const size_t matrices = 2;
+
+        static size_t getSize(uint32_t bins){
+            return header_size + 2 * bins * sizeof(float);
+        }
+
+        // the fixed fields, message vectors untouched
+        static bool decodeHeader(const uint8_t * p, size_t size, Message & message){
+            if (size < header_size) {
+                return false;
+            }
+            uint32_t words[2];
+            unpack(p, 2, words);
+            float floats[4];
+            unpack(p + 8, 4, floats);
+            message.frame_counter = words[0];
+            message.num_bins = words[1];
+            message.bin_length = floats[0];
+            message.sample_frequency = floats[1];
+            message.carrier_frequency = floats[2];
+            message.range_offset = floats[3];
+            return (Bins == 0 || message.num_bins == Bins) && size >= getSize(message.num_bins);
+        }
+
+        // vectors keep their capacity from one record to the next
+        static bool decode(const uint8_t * p, size_t size, Message & message){
+            if (!decodeHeader(p, size, message)) {
+                return false;
+            }
+            const size_t bins = Bins ? Bins : message.num_bins;
+            (message.*A).resize(bins);
+            (message.*B).resize(bins);
+            if (Bins) {
+                unpack<Bins>(p + header_size, (message.*A).data());
+                unpack<Bins>(p + header_size + Bins * sizeof(float), (message.*B).data());
+            } else {
+                unpack(p + header_size, bins, (message.*A).data());
+                unpack(p + header_size + bins * sizeof(float), bins, (message.*B).data());
+            }
+            return true;
+        }
+
+        static void encode(const Message & message, Bytes & record){
+            const uint32_t bins = (message.*A).size();
+            record.resize(getSize(bins));
+            const uint32_t words[2] = {message.frame_counter, bins};
+            const float floats[4] = {message.bin_length, message.sample_frequency, message.carrier_frequency, message.range_offset};
+            pack(words, 2, record.data());
+            pack(floats, 4, record.data() + 8);
+            pack((message.*A).data(), bins, record.data() + header_size);
+            pack((message.*B).data(), bins, record.data() + header_size + bins * sizeof(float));
+        }
+    };
+
+    template<size_t Bins>
+    struct Decoder<XeThru::BasebandApDataType, Bins> :
+        BasebandDecoder<XeThru::BasebandApData, &XeThru::BasebandApData::amplitude, &XeThru::BasebandApData::phase, Bins> {};
+
+    template<size_t Bins>
+    struct Decoder<XeThru::BasebandIqDataType, Bins> :
+        BasebandDecoder<XeThru::BasebandIqData, &XeThru::BasebandIqData::i_data, &XeThru::BasebandIqData::q_data, Bins> {};
+
+    //--------------------------------------------------------------
+    // the byte variants carry byte_step_start and byte_step_size after
+    // the six counters, the float variants go straight on with fps
+    static inline void getFloats(XeThru::PulseDopplerFloatData & message, const float * floats){
+        message.fps = floats[0];
+        message.fps_decimated = floats[1];
+        message.frequency_start = floats[2];
+        message.frequency_step = floats[3];
+        message.range = floats[4];
+    }
+
+    static inline void getFloats(XeThru::PulseDopplerByteData & message, const float * floats){
+        message.byte_step_start = floats[0];
+        message.byte_step_size = floats[1];
+        message.fps = floats[2];
+        message.fps_decimated = floats[3];
+        message.frequency_start = floats[4];
+        message.frequency_step = floats[5];
+        message.range = floats[6];
+    }
+
+    static inline void unpackValues(const uint8_t * p, size_t count, float * data){
+        unpack(p, count, data);
+    }
+
+    static inline void unpackValues(const uint8_t * p, size_t count, unsigned char * data){
+        std::memcpy(data, p, count);
+    }
+
+    template<typename Message, size_t Bins>
+    struct PulseDopplerDecoder {
+        typedef Message Data;
+        typedef typename std::remove_reference<decltype(Message().data[0])>::type Value;
+        static const size_t float_fields = sizeof(Value) == 1 ? 7 : 5;
+        static const size_t header_size = (6 + float_fields) * 4;
+
+        static size_t getSize(uint32_t bins){
+            return header_size + bins * sizeof(Value);
+        }
+
+        static bool decode(const uint8_t * p, size_t size, Message & message){
+            if (size < header_size) {
+                return false;
+            }
+            uint32_t words[6];
+            unpack(p, 6, words);
+            float floats[7];
+            unpack(p + 24, float_fields, floats);
+            message.frame_counter = words[0];
+            message.matrix_counter = words[1];
+            message.range_idx = words[2];
+            message.range_bins = words[3];
+            message.frequency_count = words[4];
+            message.pulsedoppler_instance = words[5];
+            getFloats(message, floats);
+            const size_t bins = Bins ? Bins : message.frequency_count;
+            if ((Bins && message.frequency_count != Bins) || size < getSize(bins)) {
+                return false;
+            }
+            message.data.resize(bins);
+            unpackValues(p + header_size, bins, message.data.data());
+            return true;
+        }
+    };
+
+    template<size_t Bins>
+    struct Decoder<XeThru::PulseDopplerFloatDataType, Bins> : PulseDopplerDecoder<XeThru::PulseDopplerFloatData, Bins> {};
+
+    template<size_t Bins>
+    struct Decoder<XeThru::PulseDopplerByteDataType, Bins> : PulseDopplerDecoder<XeThru::PulseDopplerByteData, Bins> {};
+
+    template<size_t Bins>
+    struct Decoder<XeThru::NoiseMapFloatDataType, Bins> : PulseDopplerDecoder<XeThru::PulseDopplerFloatData, Bins> {};
+
+    template<size_t Bins>
+    struct Decoder<XeThru::NoiseMapByteDataType, Bins> : PulseDopplerDecoder<XeThru::PulseDopplerByteData, Bins> {};
+
+    //--------------------------------------------------------------
+    template<size_t Bins>
+    struct Decoder<XeThru::FloatDataType, Bins> {
+        typedef XeThru::DataFloat Data;
+        static const size_t header_size = 3 * 4;
+        static const size_t matrices = 1;
+
+        static size_t getSize(uint32_t bins){
+            return header_size + bins * sizeof(float);
+        }
+
+        static bool decodeHeader(const uint8_t * p, size_t size, XeThru::DataFloat & message){
+            if (size < header_size) {
+                return false;
+            }
+            uint32_t words[3];
+            unpack(p, 3, words);
+            message.content_id = words[0];
+            message.info = words[1];
+            return (Bins == 0 || words[2] == Bins) && size >= getSize(words[2]);
+        }
+
+        static bool decode(const uint8_t * p, size_t size, XeThru::DataFloat & message){
+            if (!decodeHeader(p, size, message)) {
+                return false;
+            }
+            uint32_t bins = Bins;
+            if (!Bins) {
+                unpack(p + 8, 1, &bins);
+            }
+            message.data.resize(bins);
+            if (Bins) {
+                unpack<Bins>(p + header_size, message.data.data());
+            } else {
+                unpack(p + header_size, bins, message.data.data());
+            }
+            return true;
+        }
+
+        static void encode(const XeThru::DataFloat & message, Bytes & record){
+            const uint32_t bins = message.data.size();
+            record.resize(getSize(bins));
+            const uint32_t words[3] = {message.content_id, message.info, bins};
+            pack(words, 3, record.data());
+            pack(message.data.data(), bins, record.data() + header_size);
+        }
+    };
+
+    //--------------------------------------------------------------
+    // one record of a known type
+    template<uint32_t Type, size_t Bins = 0>
+    static bool decode(const ofxXeThruRecord & record, typename Decoder<Type, Bins>::Data & message){
+        return !record.is_user_header && record.data_type == Type && Decoder<Type, Bins>::decode(record.data, record.size, message);
+    }
+
+    // Hands a record of any supported type to visitor(message), the one
+    // runtime switch per record, each case a fully specialised decoder.
+    // The messages are the visitor's, so their vectors are reused.
+    template<typename Visitor>
+    struct Messages {
+        XeThru::BasebandApData baseband_ap;
+        XeThru::BasebandIqData baseband_iq;
+        XeThru::PulseDopplerFloatData pulsedoppler_float;
+        XeThru::PulseDopplerByteData pulsedoppler_byte;
+        XeThru::DataFloat float_data;
+
+        bool decode(const ofxXeThruRecord & record, Visitor & visitor){
+            if (record.is_user_header) {
+                return false;
+            }
+            switch (record.data_type) {
+                case XeThru::BasebandApDataType: return visit<XeThru::BasebandApDataType>(record, baseband_ap, visitor);
+                case XeThru::BasebandIqDataType: return visit<XeThru::BasebandIqDataType>(record, baseband_iq, visitor);
+                case XeThru::PulseDopplerFloatDataType: return visit<XeThru::PulseDopplerFloatDataType>(record, pulsedoppler_float, visitor);
+                case XeThru::PulseDopplerByteDataType: return visit<XeThru::PulseDopplerByteDataType>(record, pulsedoppler_byte, visitor);
+                case XeThru::NoiseMapFloatDataType: return visit<XeThru::NoiseMapFloatDataType>(record, pulsedoppler_float, visitor);
+                case XeThru::NoiseMapByteDataType: return visit<XeThru::NoiseMapByteDataType>(record, pulsedoppler_byte, visitor);
+                case XeThru::FloatDataType: return visit<XeThru::FloatDataType>(record, float_data, visitor);
+                default: return false;
+            }
+        }
+
+    private:
+
+        template<uint32_t Type, typename Message>
+        static bool visit(const ofxXeThruRecord & record, Message & message, Visitor & visitor){
+            if (!Decoder<Type>::decode(record.data, record.size, message)) {
+                return false;
+            }
+            visitor(Type, message);
+            return true;
+        }
+    };
+}
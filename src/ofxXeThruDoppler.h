@@ -0,0 +1,176 @@
+//
+//  ofxXeThruDoppler.h
+//  Host-side pulse-Doppler on baseband frames. Every range bin keeps a
+//  sliding slow-time window and its DFT is updated in place as frames come
+//  in (sliding DFT), so each frame costs range_bins * window complex
+//  multiply-adds no matter how often a spectrum is emitted. The output uses
+//  the PulseDopplerFloatData layout the module sends, one entry per range bin.
+//
+
+#pragma once
+
+#include "Data.hpp"
+
+#include <vector>
+#include <complex>
+#include <cmath>
+
+class ofxXeThruDoppler {
+
+public:
+
+    // window: slow-time length and number of Doppler bins
+    // decimation: frames averaged into one slow-time sample
+    // hop: decimated samples between emitted spectra
+    void setup(size_t _range_bins, size_t _window, float _fps,
+               size_t _decimation = 1, size_t _hop = 1, uint32_t _instance = 0){
+        range_bins = _range_bins;
+        window = _window;
+        fps = _fps;
+        decimation = _decimation ? _decimation : 1;
+        hop = _hop ? _hop : 1;
+        instance = _instance;
+
+        // range-major, one contiguous row of window samples per range bin
+        history.assign(range_bins * window, std::complex<float>(0, 0));
+        // double accumulators so rounding doesn't drift over days of frames
+        spectrum.assign(range_bins * window, std::complex<double>(0, 0));
+        twiddle.resize(window);
+        for (size_t k = 0; k < window; ++k) {
+            const double w = 2.0 * M_PI * k / window;
+            twiddle[k] = std::complex<double>(std::cos(w), std::sin(w));
+        }
+        accumulator.assign(range_bins, std::complex<float>(0, 0));
+
+        const float fps_decimated = fps / decimation;
+        matrix.resize(range_bins);
+        for (size_t r = 0; r < range_bins; ++r) {
+            XeThru::PulseDopplerFloatData & row = matrix[r];
+            row.range_idx = r;
+            row.range_bins = range_bins;
+            row.frequency_count = window;
+            row.pulsedoppler_instance = instance;
+            row.fps = fps;
+            row.fps_decimated = fps_decimated;
+            row.frequency_step = fps_decimated / window;
+            // bin window / 2 is DC after the shift in emit(), odd windows too
+            row.frequency_start = -float(window / 2) * row.frequency_step;
+            row.data.assign(window, 0.0f);
+        }
+
+        position = 0;
+        filled = 0;
+        accumulated = 0;
+        since_emit = 0;
+        matrix_counter = 0;
+    }
+
+    // returns true when a new spectrum is ready in getMatrix()
+    bool update(const XeThru::BasebandIqData & iq){
+        if (iq.i_data.size() < iq.num_bins || iq.q_data.size() < iq.num_bins) {
+            return false;
+        }
+        if (iq.num_bins != range_bins) {
+            // new frame area, the old history doesn't apply to it
+            setup(iq.num_bins, window, fps, decimation, hop, instance);
+        }
+        range_offset = iq.range_offset;
+        bin_length = iq.bin_length;
+        return update(iq.frame_counter, iq.i_data.data(), iq.q_data.data());
+    }
+
+    // i and q hold range_bins samples each
+    bool update(uint32_t frame_counter, const float * i, const float * q){
+        for (size_t r = 0; r < range_bins; ++r) {
+            accumulator[r] += std::complex<float>(i[r], q[r]);
+        }
+        if (++accumulated < decimation) {
+            return false;
+        }
+        const float scale = 1.0f / accumulated;
+        accumulated = 0;
+
+        // X_k <- (X_k + x_new - x_old) * e^(j 2 pi k / N)
+        for (size_t r = 0; r < range_bins; ++r) {
+            std::complex<float> & slot = history[r * window + position];
+            const std::complex<float> sample = accumulator[r] * scale;
+            const std::complex<double> delta(sample.real() - slot.real(), sample.imag() - slot.imag());
+            slot = sample;
+            accumulator[r] = std::complex<float>(0, 0);
+
+            std::complex<double> * bins = &spectrum[r * window];
+            for (size_t k = 0; k < window; ++k) {
+                bins[k] = (bins[k] + delta) * twiddle[k];
+            }
+        }
+        position = (position + 1) % window;
+        if (filled < window) {
+            ++filled;
+        }
+
+        last_frame_counter = frame_counter;
+        if (filled < window || ++since_emit < hop) {
+            return false;
+        }
+        since_emit = 0;
+        emit();
+        return true;
+    }
+
+    // one PulseDopplerFloatData per range bin, power ordered from
+    // frequency_start (window / 2 steps below DC) up, like the module output
+    const std::vector<XeThru::PulseDopplerFloatData> & getMatrix() const {
+        return matrix;
+    }
+
+    size_t getWindow() const {
+        return window;
+    }
+
+    size_t getRangeBins() const {
+        return range_bins;
+    }
+
+private:
+
+    // the sliding DFT leaves X_k referenced to the oldest sample, so the
+    // phase is off by a rotation but power is exact
+    void emit(){
+        ++matrix_counter;
+        const double norm = 1.0 / (double(window) * window);
+        const size_t half = window / 2;
+        for (size_t r = 0; r < range_bins; ++r) {
+            XeThru::PulseDopplerFloatData & row = matrix[r];
+            row.frame_counter = last_frame_counter;
+            row.matrix_counter = matrix_counter;
+            row.range = range_offset + r * bin_length;
+            const std::complex<double> * bins = &spectrum[r * window];
+            for (size_t k = 0; k < window; ++k) {
+                // fftshift, negative frequencies first
+                row.data[k] = std::norm(bins[(k + window - half) % window]) * norm;
+            }
+        }
+    }
+
+    size_t range_bins = 0;
+    size_t window = 0;
+    size_t decimation = 1;
+    size_t hop = 1;
+    uint32_t instance = 0;
+    float fps = 0;
+    float range_offset = 0;
+    float bin_length = 0;
+
+    std::vector<std::complex<float>> history;
+    std::vector<std::complex<double>> spectrum;
+    std::vector<std::complex<double>> twiddle;
+    std::vector<std::complex<float>> accumulator;
+    std::vector<XeThru::PulseDopplerFloatData> matrix;
+
+    size_t position = 0;
+    size_t filled = 0;
+    size_t accumulated = 0;
+    size_t since_emit = 0;
+    uint32_t matrix_counter = 0;
+    uint32_t last_frame_counter = 0;
+};
@@ -0,0 +1,373 @@
+//
+//  ofxXeThruDsp.h
+//  Vectorised baseband math on the struct-of-arrays layout BasebandIqData
+//  uses: IQ to amplitude/phase, power in dB and host-side downconversion of
+//  RF DataFloat frames. SSE2 on x86, NEON on arm64, scalar everywhere else.
+//
+
+#pragma once
+
+#include "Data.hpp"
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OFXXETHRU_SIMD_SSE 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define OFXXETHRU_SIMD_NEON 1
+#endif
+
+namespace ofxXeThruSimd {
+
+    // four lanes of float, just enough to write each kernel once
+
+#if defined(OFXXETHRU_SIMD_SSE)
+    #define OFXXETHRU_SIMD 1
+    typedef __m128 v4;
+    inline v4 load(const float * p){ return _mm_loadu_ps(p); }
+    inline void store(float * p, v4 a){ _mm_storeu_ps(p, a); }
+    inline v4 set1(float a){ return _mm_set1_ps(a); }
+    inline v4 add(v4 a, v4 b){ return _mm_add_ps(a, b); }
+    inline v4 sub(v4 a, v4 b){ return _mm_sub_ps(a, b); }
+    inline v4 mul(v4 a, v4 b){ return _mm_mul_ps(a, b); }
+    inline v4 div(v4 a, v4 b){ return _mm_div_ps(a, b); }
+    inline v4 madd(v4 a, v4 b, v4 c){ return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    inline v4 sqrt(v4 a){ return _mm_sqrt_ps(a); }
+    inline v4 min(v4 a, v4 b){ return _mm_min_ps(a, b); }
+    inline v4 max(v4 a, v4 b){ return _mm_max_ps(a, b); }
+    inline v4 abs(v4 a){ return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+    inline v4 signbit(v4 a){ return _mm_and_ps(_mm_set1_ps(-0.0f), a); }
+    inline v4 bitor_(v4 a, v4 b){ return _mm_or_ps(a, b); }
+    inline v4 less(v4 a, v4 b){ return _mm_cmplt_ps(a, b); }
+    inline v4 select(v4 mask, v4 a, v4 b){ return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+    inline float sum(v4 a){
+        float lanes[4];
+        _mm_storeu_ps(lanes, a);
+        return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    }
+    // a = m * 2^e with m in [1, 2)
+    inline v4 exponent(v4 a){
+        __m128i e = _mm_srli_epi32(_mm_castps_si128(a), 23);
+        return _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(e, _mm_set1_epi32(0xff)), _mm_set1_epi32(127)));
+    }
+    inline v4 mantissa(v4 a){
+        __m128i m = _mm_and_si128(_mm_castps_si128(a), _mm_set1_epi32(0x007fffff));
+        return _mm_castsi128_ps(_mm_or_si128(m, _mm_set1_epi32(0x3f800000)));
+    }
+
+    // two lanes of double, for accumulators that outgrow a float
+    typedef __m128d v2d;
+    inline v2d load(const double * p){ return _mm_loadu_pd(p); }
+    inline void store(double * p, v2d a){ _mm_storeu_pd(p, a); }
+    inline v2d set1d(double a){ return _mm_set1_pd(a); }
+    // two floats from p, widened
+    inline v2d widen(const float * p){ return _mm_cvtps_pd(_mm_castsi128_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)))); }
+    inline v2d sub(v2d a, v2d b){ return _mm_sub_pd(a, b); }
+    inline v2d madd(v2d a, v2d b, v2d c){ return _mm_add_pd(_mm_mul_pd(a, b), c); }
+#elif defined(OFXXETHRU_SIMD_NEON)
+    #define OFXXETHRU_SIMD 1
+    typedef float32x4_t v4;
+    inline v4 load(const float * p){ return vld1q_f32(p); }
+    inline void store(float * p, v4 a){ vst1q_f32(p, a); }
+    inline v4 set1(float a){ return vdupq_n_f32(a); }
+    inline v4 add(v4 a, v4 b){ return vaddq_f32(a, b); }
+    inline v4 sub(v4 a, v4 b){ return vsubq_f32(a, b); }
+    inline v4 mul(v4 a, v4 b){ return vmulq_f32(a, b); }
+    inline v4 div(v4 a, v4 b){ return vdivq_f32(a, b); }
+    inline v4 madd(v4 a, v4 b, v4 c){ return vfmaq_f32(c, a, b); }
+    inline v4 sqrt(v4 a){ return vsqrtq_f32(a); }
+    inline v4 min(v4 a, v4 b){ return vminq_f32(a, b); }
+    inline v4 max(v4 a, v4 b){ return vmaxq_f32(a, b); }
+    inline v4 abs(v4 a){ return vabsq_f32(a); }
+    inline v4 signbit(v4 a){ return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x80000000))); }
+    inline v4 bitor_(v4 a, v4 b){ return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+    inline v4 less(v4 a, v4 b){ return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+    inline v4 select(v4 mask, v4 a, v4 b){ return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+    inline float sum(v4 a){ return vaddvq_f32(a); }
+    inline v4 exponent(v4 a){
+        uint32x4_t e = vandq_u32(vshrq_n_u32(vreinterpretq_u32_f32(a), 23), vdupq_n_u32(0xff));
+        return vcvtq_f32_s32(vsubq_s32(vreinterpretq_s32_u32(e), vdupq_n_s32(127)));
+    }
+    inline v4 mantissa(v4 a){
+        uint32x4_t m = vandq_u32(vreinterpretq_u32_f32(a), vdupq_n_u32(0x007fffff));
+        return vreinterpretq_f32_u32(vorrq_u32(m, vdupq_n_u32(0x3f800000)));
+    }
+
+    typedef float64x2_t v2d;
+    inline v2d load(const double * p){ return vld1q_f64(p); }
+    inline void store(double * p, v2d a){ vst1q_f64(p, a); }
+    inline v2d set1d(double a){ return vdupq_n_f64(a); }
+    inline v2d widen(const float * p){ return vcvt_f64_f32(vld1_f32(p)); }
+    inline v2d sub(v2d a, v2d b){ return vsubq_f64(a, b); }
+    inline v2d madd(v2d a, v2d b, v2d c){ return vfmaq_f64(c, a, b); }
+#endif
+
+#if defined(OFXXETHRU_SIMD)
+    // atan on [0, 1], Abramowitz & Stegun 4.4.49, |error| < 2e-8
+    inline v4 atan01(v4 x){
+        const v4 s = mul(x, x);
+        v4 p = set1(0.0028662257f);
+        p = madd(p, s, set1(-0.0161657367f));
+        p = madd(p, s, set1(0.0429096138f));
+        p = madd(p, s, set1(-0.0752896400f));
+        p = madd(p, s, set1(0.1065626393f));
+        p = madd(p, s, set1(-0.1420889944f));
+        p = madd(p, s, set1(0.1999355085f));
+        p = madd(p, s, set1(-0.3333314528f));
+        return madd(mul(x, s), p, x);
+    }
+
+    inline v4 atan2(v4 y, v4 x){
+        const v4 ax = abs(x);
+        const v4 ay = abs(y);
+        const v4 hi = max(ax, ay);
+        const v4 lo = min(ax, ay);
+        // 0 / 0 gives 0 rather than nan
+        const v4 zero = set1(0.0f);
+        v4 r = atan01(select(less(zero, hi), div(lo, hi), zero));
+        r = select(less(ax, ay), sub(set1(1.57079632679f), r), r);
+        r = select(less(x, zero), sub(set1(3.14159265359f), r), r);
+        return bitor_(r, signbit(y));
+    }
+
+    // log2 via log(m) = 2 atanh((m - 1) / (m + 1)) with m in [sqrt(.5), sqrt(2))
+    inline v4 log2(v4 a){
+        v4 e = exponent(a);
+        v4 m = mantissa(a);
+        const v4 big = less(set1(1.41421356f), m);
+        m = select(big, mul(m, set1(0.5f)), m);
+        e = select(big, add(e, set1(1.0f)), e);
+        const v4 one = set1(1.0f);
+        const v4 z = div(sub(m, one), add(m, one));
+        const v4 s = mul(z, z);
+        v4 p = set1(1.0f / 7.0f);
+        p = madd(p, s, set1(1.0f / 5.0f));
+        p = madd(p, s, set1(1.0f / 3.0f));
+        p = madd(p, s, one);
+        return madd(mul(z, p), set1(2.0f / 0.69314718056f), e);
+    }
+#endif
+
+} // namespace ofxXeThruSimd
+
+
+class ofxXeThruDsp {
+
+public:
+
+    // amplitude[x] = sqrt(i[x]^2 + q[x]^2)
+    static void amplitude(const float * i, const float * q, float * amplitude, size_t n){
+        size_t x = 0;
+#if defined(OFXXETHRU_SIMD)
+        using namespace ofxXeThruSimd;
+        for (; x + 4 <= n; x += 4) {
+            const v4 vi = load(i + x);
+            const v4 vq = load(q + x);
+            store(amplitude + x, ofxXeThruSimd::sqrt(madd(vi, vi, mul(vq, vq))));
+        }
+#endif
+        for (; x < n; ++x) {
+            amplitude[x] = std::sqrt(i[x] * i[x] + q[x] * q[x]);
+        }
+    }
+
+    // phase[x] = atan2(q[x], i[x]) in radians
+    static void phase(const float * i, const float * q, float * phase, size_t n){
+        size_t x = 0;
+#if defined(OFXXETHRU_SIMD)
+        using namespace ofxXeThruSimd;
+        for (; x + 4 <= n; x += 4) {
+            store(phase + x, ofxXeThruSimd::atan2(load(q + x), load(i + x)));
+        }
+#endif
+        for (; x < n; ++x) {
+            phase[x] = std::atan2(q[x], i[x]);
+        }
+    }
+
+    // db[x] = 10 log10(i[x]^2 + q[x]^2), floored at -200 dB
+    static void powerDb(const float * i, const float * q, float * db, size_t n){
+        const float floor = 1e-20f;
+        const float scale = 10.0f * 0.30102999566f;
+        size_t x = 0;
+#if defined(OFXXETHRU_SIMD)
+        using namespace ofxXeThruSimd;
+        for (; x + 4 <= n; x += 4) {
+            const v4 vi = load(i + x);
+            const v4 vq = load(q + x);
+            const v4 power = ofxXeThruSimd::max(madd(vi, vi, mul(vq, vq)), set1(floor));
+            store(db + x, mul(ofxXeThruSimd::log2(power), set1(scale)));
+        }
+#endif
+        for (; x < n; ++x) {
+            db[x] = 10.0f * std::log10(std::max(i[x] * i[x] + q[x] * q[x], floor));
+        }
+    }
+
+    // fills ap from iq, reusing the capacity of ap's vectors
+    static void toAmplitudePhase(const XeThru::BasebandIqData & iq, XeThru::BasebandApData & ap){
+        ap.frame_counter = iq.frame_counter;
+        ap.num_bins = iq.num_bins;
+        ap.bin_length = iq.bin_length;
+        ap.sample_frequency = iq.sample_frequency;
+        ap.carrier_frequency = iq.carrier_frequency;
+        ap.range_offset = iq.range_offset;
+        ap.amplitude.resize(iq.num_bins);
+        ap.phase.resize(iq.num_bins);
+        amplitude(iq.i_data.data(), iq.q_data.data(), ap.amplitude.data(), iq.num_bins);
+        phase(iq.i_data.data(), iq.q_data.data(), ap.phase.data(), iq.num_bins);
+    }
+
+    // a downconverted DataFloat carries all I values followed by all Q values
+    static void splitIq(const XeThru::DataFloat & frame, XeThru::BasebandIqData & iq){
+        const size_t bins = frame.data.size() / 2;
+        iq.frame_counter = frame.info;
+        iq.num_bins = bins;
+        iq.i_data.assign(frame.data.begin(), frame.data.begin() + bins);
+        iq.q_data.assign(frame.data.begin() + bins, frame.data.begin() + bins * 2);
+    }
+
+    // sum of a[x] * b[x]
+    static float dot(const float * a, const float * b, size_t n){
+        size_t x = 0;
+        float result = 0;
+#if defined(OFXXETHRU_SIMD)
+        using namespace ofxXeThruSimd;
+        v4 acc = set1(0.0f);
+        for (; x + 4 <= n; x += 4) {
+            acc = madd(load(a + x), load(b + x), acc);
+        }
+        result = ofxXeThruSimd::sum(acc);
+#endif
+        for (; x < n; ++x) {
+            result += a[x] * b[x];
+        }
+        return result;
+    }
+
+    // out[x] = a[x] * b[x]
+    static void multiply(const float * a, const float * b, float * out, size_t n){
+        size_t x = 0;
+#if defined(OFXXETHRU_SIMD)
+        using namespace ofxXeThruSimd;
+        for (; x + 4 <= n; x += 4) {
+            store(out + x, mul(load(a + x), load(b + x)));
+        }
+#endif
+        for (; x < n; ++x) {
+            out[x] = a[x] * b[x];
+        }
+    }
+};
+
+
+// Host-side digital downconversion of RF frames, the same job the module
+// does with x4driver_set_downconversion(1): mix with the carrier, low-pass
+// filter and decimate. Mixing tables and filter taps are computed once in
+// setup(), process() allocates nothing.
+class ofxXeThruDownconverter {
+
+public:
+
+    // X4 defaults: 23.328 GHz sampling, 7.29 GHz carrier (tx_center_frequency 3),
+    // decimation by 8 like the chip
+    void setup(size_t _rf_bins,
+               float _carrier_frequency = 7.29e9f,
+               float _sample_frequency = 23.328e9f,
+               size_t _decimation = 8,
+               size_t taps = 31){
+        rf_bins = _rf_bins;
+        carrier_frequency = _carrier_frequency;
+        sample_frequency = _sample_frequency;
+        decimation = _decimation;
+        half = taps / 2;
+
+        // carrier tables, scaled by 2 so the baseband keeps the RF amplitude
+        cos_table.resize(rf_bins);
+        sin_table.resize(rf_bins);
+        const double w = 2.0 * M_PI * carrier_frequency / sample_frequency;
+        for (size_t n = 0; n < rf_bins; ++n) {
+            cos_table[n] = 2.0 * std::cos(w * n);
+            sin_table[n] = -2.0 * std::sin(w * n);
+        }
+
+        // Hamming windowed sinc, cut off at the decimated Nyquist rate
+        filter.assign(half * 2 + 1, 0.0f);
+        const double cutoff = 0.5 / decimation;
+        double total = 0;
+        for (size_t t = 0; t < filter.size(); ++t) {
+            const double k = double(t) - double(half);
+            const double sinc = k == 0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * k) / (M_PI * k);
+            const double window = 0.54 - 0.46 * std::cos(2.0 * M_PI * t / (filter.size() - 1));
+            filter[t] = sinc * window;
+            total += filter[t];
+        }
+        for (float & h : filter) {
+            h /= total;
+        }
+
+        // zero padded on both sides so the filter never runs off the frame
+        mixed_i.assign(rf_bins + half * 2, 0.0f);
+        mixed_q.assign(rf_bins + half * 2, 0.0f);
+    }
+
+    size_t getBasebandBins() const {
+        return decimation ? (rf_bins + decimation - 1) / decimation : 0;
+    }
+
+    // rf holds rf_bins samples, i and q receive getBasebandBins() values
+    void process(const float * rf, float * i, float * q){
+        ofxXeThruDsp::multiply(rf, cos_table.data(), mixed_i.data() + half, rf_bins);
+        ofxXeThruDsp::multiply(rf, sin_table.data(), mixed_q.data() + half, rf_bins);
+        const size_t bins = getBasebandBins();
+        for (size_t k = 0; k < bins; ++k) {
+            // output k is centred on rf sample k * decimation
+            const size_t start = k * decimation;
+            i[k] = ofxXeThruDsp::dot(mixed_i.data() + start, filter.data(), filter.size());
+            q[k] = ofxXeThruDsp::dot(mixed_q.data() + start, filter.data(), filter.size());
+        }
+    }
+
+    // rf frame from XEP with downconversion off, iq keeps its capacity
+    void process(const XeThru::DataFloat & rf, XeThru::BasebandIqData & iq){
+        if (rf.data.size() != rf_bins) {
+            setup(rf.data.size(), carrier_frequency, sample_frequency, decimation, half * 2 + 1);
+        }
+        const size_t bins = getBasebandBins();
+        iq.frame_counter = rf.info;
+        iq.num_bins = bins;
+        iq.bin_length = 299792458.0f / (2.0f * sample_frequency) * decimation;
+        iq.sample_frequency = sample_frequency;
+        iq.carrier_frequency = carrier_frequency;
+        iq.range_offset = range_offset;
+        iq.i_data.resize(bins);
+        iq.q_data.resize(bins);
+        process(rf.data.data(), iq.i_data.data(), iq.q_data.data());
+    }
+
+    // first bin range in meters, copied into every BasebandIqData
+    void setRangeOffset(float _range_offset){
+        range_offset = _range_offset;
+    }
+
+private:
+
+    size_t rf_bins = 0;
+    size_t decimation = 8;
+    size_t half = 0;
+    float carrier_frequency = 7.29e9f;
+    float sample_frequency = 23.328e9f;
+    float range_offset = 0;
+
+    std::vector<float> cos_table;
+    std::vector<float> sin_table;
+    std::vector<float> filter;
+    std::vector<float> mixed_i;
+    std::vector<float> mixed_q;
+};
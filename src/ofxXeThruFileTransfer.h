@@ -0,0 +1,188 @@
+//
+//  ofxXeThruFileTransfer.h
+//  Chunked module file transfer over the XEP file API, straight into and
+//  out of caller buffers, with progress and cancel.
+//
+//  Every get_file_data()/set_file_data() is one blocking round trip on the
+//  link, so what a transfer costs is the number of chunks. The chunk size
+//  starts at setChunkSize() and doubles while the module takes it, up to
+//  max_chunk, a chunk the module refuses is halved and sent again. The
+//  size that worked is kept for the next transfer on the same object.
+//  The one Bytes per direction the XEP calls need is reused, so a
+//  transfer allocates nothing once it has run.
+//
+//  A connector answers one request at a time, the parallelism is across
+//  modules: one transfer object per module, on that module's thread, see
+//  ofxXeThru::runOnModule() and ofxXeThruManager::runOnModules().
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include "XEP.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+// bytes done and the file length, false cancels the transfer
+typedef std::function<bool(size_t done, size_t total)> ofxXeThruTransferProgress;
+
+class ofxXeThruFileTransfer {
+
+public:
+
+    ofxXeThruFileTransfer(uint32_t _chunk_size = 1024){
+        setChunkSize(_chunk_size);
+    }
+
+    void setChunkSize(uint32_t size){
+        chunk_size = std::max(min_chunk, std::min(size, max_chunk));
+    }
+
+    // largest chunk the module took so far
+    uint32_t getChunkSize() const {
+        return chunk_size;
+    }
+
+    // 0 on success
+    // listed by the module, no file is opened
+    static bool exists(XeThru::XEP & xep, uint32_t type, uint32_t identifier){
+        XeThru::Files files;
+        if (xep.find_all_files(files)) {
+            return false;
+        }
+        for (size_t f = 0; f < files.file_type_items.size() && f < files.file_identifier_items.size(); ++f) {
+            if (uint32_t(files.file_type_items[f]) == type && uint32_t(files.file_identifier_items[f]) == identifier) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static int getLength(XeThru::XEP & xep, uint32_t type, uint32_t identifier, uint32_t & length){
+        return xep.get_file_length(type, identifier, length);
+    }
+
+    // Reads the whole file into data, which holds capacity bytes. size is
+    // the file length, also when it doesn't fit, then nothing is read.
+    // 0 on success.
+    int read(XeThru::XEP & xep, uint32_t type, uint32_t identifier, uint8_t * data, size_t capacity, size_t & size,
+        ofxXeThruTransferProgress progress = nullptr){
+        size = 0;
+        if (xep.open_file(type, identifier)) {
+            ofLogError("ofxXeThruFileTransfer") << "no file " << type << "/" << identifier;
+            return 1;
+        }
+        uint32_t length = 0;
+        int status = getLength(xep, type, identifier, length);
+        size = length;
+        if (status == 0 && length > capacity) {
+            ofLogError("ofxXeThruFileTransfer") << "file " << type << "/" << identifier << " is " << length
+                << " bytes, the buffer " << capacity;
+            status = 1;
+        }
+        size_t done = 0;
+        while (status == 0 && done < length) {
+            const uint32_t want = std::min<size_t>(chunk_size, length - done);
+            if (xep.get_file_data(type, identifier, done, want, incoming) || incoming.empty()) {
+                status = refuse(want);
+                continue;
+            }
+            const size_t got = std::min<size_t>(incoming.size(), want);
+            std::memcpy(data + done, incoming.data(), got);
+            done += got;
+            accept(want);
+            if (progress && !progress(done, length)) {
+                status = 1;
+            }
+        }
+        xep.close_file(type, identifier, false);
+        return status;
+    }
+
+    // sizes data to the file once, then reads into it
+    int read(XeThru::XEP & xep, uint32_t type, uint32_t identifier, std::vector<uint8_t> & data,
+        ofxXeThruTransferProgress progress = nullptr){
+        uint32_t length = 0;
+        if (xep.open_file(type, identifier) || getLength(xep, type, identifier, length)) {
+            xep.close_file(type, identifier, false);
+            ofLogError("ofxXeThruFileTransfer") << "no file " << type << "/" << identifier;
+            return 1;
+        }
+        xep.close_file(type, identifier, false);
+        data.resize(length);
+        size_t size = 0;
+        const int status = read(xep, type, identifier, data.data(), data.size(), size, progress);
+        data.resize(status == 0 ? size : 0);
+        return status;
+    }
+
+    // Replaces the file with size bytes of data, committed only when all
+    // of it was written. 0 on success.
+    int write(XeThru::XEP & xep, uint32_t type, uint32_t identifier, const uint8_t * data, size_t size,
+        ofxXeThruTransferProgress progress = nullptr){
+        if (xep.create_file(type, identifier, size)) {
+            // create_file() doesn't replace, but it fails for other reasons
+            // too: only a file that is there is deleted and created again
+            if (!exists(xep, type, identifier) || xep.delete_file(type, identifier) ||
+                xep.create_file(type, identifier, size)) {
+                ofLogError("ofxXeThruFileTransfer") << "could not create file " << type << "/" << identifier;
+                return 1;
+            }
+        }
+        int status = 0;
+        size_t done = 0;
+        while (status == 0 && done < size) {
+            const uint32_t want = std::min<size_t>(chunk_size, size - done);
+            outgoing.assign(data + done, data + done + want);
+            if (xep.set_file_data(type, identifier, done, outgoing)) {
+                status = refuse(want);
+                continue;
+            }
+            done += want;
+            accept(want);
+            if (progress && !progress(done, size)) {
+                status = 1;
+            }
+        }
+        xep.close_file(type, identifier, status == 0);
+        return status;
+    }
+
+    int write(XeThru::XEP & xep, uint32_t type, uint32_t identifier, const std::vector<uint8_t> & data,
+        ofxXeThruTransferProgress progress = nullptr){
+        return write(xep, type, identifier, data.data(), data.size(), progress);
+    }
+
+private:
+
+    static const uint32_t min_chunk = 64;
+    static const uint32_t max_chunk = 32768;
+
+    // a full chunk went through, try twice as much next time
+    void accept(uint32_t size){
+        if (size == chunk_size && !ceiling) {
+            chunk_size = std::min(chunk_size * 2, max_chunk);
+        }
+    }
+
+    // 0 to try again smaller, 1 when even the smallest chunk failed
+    int refuse(uint32_t size){
+        if (size <= min_chunk) {
+            ofLogError("ofxXeThruFileTransfer") << "module refused a " << size << " byte chunk";
+            return 1;
+        }
+        // past what the module takes, don't grow again on this object
+        chunk_size = std::max(min_chunk, size / 2);
+        ceiling = true;
+        return 0;
+    }
+
+    uint32_t chunk_size = 1024;
+    bool ceiling = false;
+    Bytes incoming;
+    Bytes outgoing;
+};
@@ -0,0 +1,16 @@
+//
+//  ofxXeThruFrame.h
+//  A DataFloat tagged with the sensor it came from and the host time it
+//  arrived, so frames from several modules can share one queue.
+//
+
+#pragma once
+
+#include "Data.hpp"
+
+struct ofxXeThruFrame : public XeThru::DataFloat {
+    // index of the sensor in its ofxXeThruManager, 0 when used alone
+    int device_id = 0;
+    // ofGetElapsedTimeMicros() when the frame was read off the port
+    uint64_t timestamp = 0;
+};
@@ -0,0 +1,111 @@
+//
+//  ofxXeThruFramePool.h
+//  Fixed-capacity frame buffers sized from the X4 frame area, so the
+//  capture path reaches a steady state with no reallocation.
+//
+
+#pragma once
+
+#include "Data.hpp"
+#include "ofxXeThruFrame.h"
+#include "ofxXeThruRingBuffer.h"
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+
+struct ofxXeThruFrameBuffer {
+    uint32_t content_id = 0;
+    uint32_t frame_counter = 0;
+    int device_id = 0;
+    uint64_t timestamp = 0;
+    size_t size = 0;
+    size_t capacity = 0;
+    float * data = nullptr;
+};
+
+class ofxXeThruFramePool {
+
+public:
+
+    // X4 samples at 23.328 GHz, one RF bin is c / (2 * fs) meters. The chip
+    // captures in blocks of 96 bins and downconversion decimates by 8.
+    static size_t getBinCount(float fa1, float fa2, bool downconversion){
+        const float rf_bin_length = 299792458.0f / (2.0f * 23.328e9f);
+        const size_t block = 96;
+        size_t bins = (size_t)std::ceil((fa2 - fa1) / rf_bin_length);
+        bins = (bins / block + 2) * block;
+        return downconversion ? bins / 8 : bins;
+    }
+
+    // floats in one DataFloat message, downconverted frames carry I then Q
+    static size_t getFrameCapacity(float fa1, float fa2, bool downconversion){
+        const size_t bins = getBinCount(fa1, fa2, downconversion);
+        return downconversion ? bins * 2 : bins;
+    }
+
+    // one contiguous block of count * capacity floats. One thread may
+    // acquire() and one other thread may release().
+    void allocate(size_t count, size_t capacity){
+        storage.assign(count * capacity, 0.0f);
+        buffers.assign(count, ofxXeThruFrameBuffer());
+        available.allocate(count);
+        for (size_t i = 0; i < count; ++i) {
+            buffers[i].capacity = capacity;
+            buffers[i].data = storage.data() + i * capacity;
+            available.push(&buffers[i]);
+        }
+    }
+
+    // nullptr when every buffer is in use
+    ofxXeThruFrameBuffer * acquire(){
+        ofxXeThruFrameBuffer * buffer = nullptr;
+        available.pop(buffer);
+        return buffer;
+    }
+
+    void release(ofxXeThruFrameBuffer * buffer){
+        buffer->size = 0;
+        available.push(buffer);
+    }
+
+    size_t getCapacity() const {
+        return buffers.empty() ? 0 : buffers[0].capacity;
+    }
+
+    size_t getNumAvailable() const {
+        return available.size();
+    }
+
+    // copies into a fixed buffer, false if the frame doesn't fit
+    static bool copy(const XeThru::DataFloat & src, ofxXeThruFrameBuffer & dst){
+        if (src.data.size() > dst.capacity) {
+            return false;
+        }
+        dst.content_id = src.content_id;
+        dst.frame_counter = src.info;
+        dst.size = src.data.size();
+        std::memcpy(dst.data, src.data.data(), dst.size * sizeof(float));
+        return true;
+    }
+
+    static bool copy(const ofxXeThruFrame & src, ofxXeThruFrameBuffer & dst){
+        if (!copy(static_cast<const XeThru::DataFloat &>(src), dst)) {
+            return false;
+        }
+        dst.device_id = src.device_id;
+        dst.timestamp = src.timestamp;
+        return true;
+    }
+
+    // readies a DataFloat so decoding into it doesn't reallocate
+    static void reserve(XeThru::DataFloat & frame, size_t capacity){
+        frame.data.reserve(capacity);
+    }
+
+private:
+
+    std::vector<float> storage;
+    std::vector<ofxXeThruFrameBuffer> buffers;
+    ofxXeThruRingBuffer<ofxXeThruFrameBuffer *> available;
+};
@@ -0,0 +1,85 @@
+//
+//  ofxXeThruHistogram.h
+//  Lock-free latency histogram. Writers on any thread add a value with
+//  one relaxed increment, readers take a snapshot and get percentiles of
+//  what came in between two snapshots, so nothing is ever reset under a
+//  writer. Buckets are log-linear, 8 per power of two: about 12% wide,
+//  exact below 8, up to 2^32.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+class ofxXeThruHistogram {
+
+public:
+
+    static const size_t sub_buckets = 8;
+    static const size_t buckets = sub_buckets + 29 * sub_buckets;
+
+    typedef std::array<uint64_t, buckets> Snapshot;
+
+    void record(uint64_t value){
+        counts[getBucket(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void read(Snapshot & snapshot) const {
+        for (size_t b = 0; b < buckets; ++b) {
+            snapshot[b] = counts[b].load(std::memory_order_relaxed);
+        }
+    }
+
+    // values recorded between before and now
+    static uint64_t getCount(const Snapshot & now, const Snapshot & before){
+        uint64_t total = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            total += now[b] - before[b];
+        }
+        return total;
+    }
+
+    // p in [0, 1] of the values recorded between before and now, the
+    // upper edge of the bucket it falls in. 0 when there were none.
+    static uint64_t getPercentile(const Snapshot & now, const Snapshot & before, double p){
+        const uint64_t total = getCount(now, before);
+        if (total == 0) {
+            return 0;
+        }
+        const uint64_t rank = std::min<uint64_t>(total - 1, uint64_t(p * total));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < buckets; ++b) {
+            seen += now[b] - before[b];
+            if (seen > rank) {
+                return getUpperEdge(b);
+            }
+        }
+        return getUpperEdge(buckets - 1);
+    }
+
+    static size_t getBucket(uint64_t value){
+        if (value < sub_buckets) {
+            return value;
+        }
+        value = std::min<uint64_t>(value, 0xffffffffu);
+        int exponent = 63 - __builtin_clzll(value);
+        // top three bits below the leading one pick the sub bucket
+        return sub_buckets + (exponent - 3) * sub_buckets + ((value >> (exponent - 3)) - sub_buckets);
+    }
+
+    static uint64_t getUpperEdge(size_t bucket){
+        if (bucket < sub_buckets) {
+            return bucket;
+        }
+        const size_t exponent = (bucket - sub_buckets) / sub_buckets + 3;
+        const uint64_t lower = uint64_t(sub_buckets + (bucket - sub_buckets) % sub_buckets) << (exponent - 3);
+        return lower + (uint64_t(1) << (exponent - 3)) - 1;
+    }
+
+private:
+
+    std::array<std::atomic<uint64_t>, buckets> counts{};
+};
@@ -0,0 +1,168 @@
+//
+//  ofxXeThruLists.h
+//  Fixed capacity versions of the list messages. PresenceMovingListData,
+//  RespirationMovingListData and RespirationDetectionListData carry their
+//  items in vectors, these hold them inline with a count, so they are
+//  trivially copyable: no allocation to copy one, and memcpy into a ring
+//  or shared memory is a valid copy.
+//
+//  ofxXeThruListReader reads through one library message per type that
+//  it reserves up front and reuses, so the vectors ModuleConnector fills
+//  keep their capacity and steady state reading allocates nothing on our
+//  side, then converts into the fixed struct. Lists longer than the
+//  capacity are cut and flagged.
+//
+
+#pragma once
+
+#include "X4M200.hpp"
+#include "X4M300.hpp"
+#include "Data.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace ofxXeThruLists {
+
+    // count items, zeros where from is shorter
+    template<size_t Capacity>
+    static inline void copy(const std::vector<float> & from, std::array<float, Capacity> & to, uint32_t count){
+        const size_t n = std::min<size_t>(count, from.size());
+        std::copy(from.begin(), from.begin() + n, to.begin());
+        std::fill(to.begin() + n, to.begin() + count, 0.0f);
+    }
+
+    template<size_t Capacity>
+    static inline uint32_t fit(size_t count, bool & truncated){
+        truncated = count > Capacity;
+        return uint32_t(std::min(count, Capacity));
+    }
+}
+
+// X4M300, one entry per movement item
+template<size_t Capacity = 64>
+struct ofxXeThruPresenceMovingList {
+    uint32_t frame_counter;
+    uint32_t presence_state;
+    uint32_t count;
+    // the message had more than Capacity items
+    bool truncated;
+    std::array<float, Capacity> movement_slow_items;
+    std::array<float, Capacity> movement_fast_items;
+    std::array<float, Capacity> detection_distance_items;
+    std::array<float, Capacity> radar_cross_section_items;
+    std::array<float, Capacity> detection_velocity_items;
+
+    void assign(const XeThru::PresenceMovingListData & message){
+        frame_counter = message.frame_counter;
+        presence_state = message.presence_state;
+        // the longest list decides, shorter ones are padded with 0
+        const size_t longest = std::max({message.movement_slow_items.size(), message.movement_fast_items.size(),
+            message.detection_distance_items.size(), message.radar_cross_section_items.size(),
+            message.detection_velocity_items.size()});
+        count = ofxXeThruLists::fit<Capacity>(longest, truncated);
+        ofxXeThruLists::copy(message.movement_slow_items, movement_slow_items, count);
+        ofxXeThruLists::copy(message.movement_fast_items, movement_fast_items, count);
+        ofxXeThruLists::copy(message.detection_distance_items, detection_distance_items, count);
+        ofxXeThruLists::copy(message.radar_cross_section_items, radar_cross_section_items, count);
+        ofxXeThruLists::copy(message.detection_velocity_items, detection_velocity_items, count);
+    }
+};
+
+// X4M200
+template<size_t Capacity = 64>
+struct ofxXeThruRespirationMovingList {
+    uint32_t counter;
+    uint32_t count;
+    bool truncated;
+    std::array<float, Capacity> movement_slow_items;
+    std::array<float, Capacity> movement_fast_items;
+
+    void assign(const XeThru::RespirationMovingListData & message){
+        counter = message.counter;
+        count = ofxXeThruLists::fit<Capacity>(std::max(message.movement_slow_items.size(), message.movement_fast_items.size()), truncated);
+        ofxXeThruLists::copy(message.movement_slow_items, movement_slow_items, count);
+        ofxXeThruLists::copy(message.movement_fast_items, movement_fast_items, count);
+    }
+};
+
+// X4M200, count detections of distance, cross section and velocity
+template<size_t Capacity = 16>
+struct ofxXeThruRespirationDetectionList {
+    uint32_t counter;
+    // as sent by the module, may be more than count when truncated
+    uint32_t detection_count;
+    uint32_t count;
+    bool truncated;
+    std::array<float, Capacity> detection_distance_items;
+    std::array<float, Capacity> detection_radar_cross_section_items;
+    std::array<float, Capacity> detection_velocity_items;
+
+    void assign(const XeThru::RespirationDetectionListData & message){
+        counter = message.counter;
+        detection_count = message.detection_count;
+        count = ofxXeThruLists::fit<Capacity>(std::max({size_t(message.detection_count), message.detection_distance_items.size(),
+            message.detection_radar_cross_section_items.size(), message.detection_velocity_items.size()}), truncated);
+        ofxXeThruLists::copy(message.detection_distance_items, detection_distance_items, count);
+        ofxXeThruLists::copy(message.detection_radar_cross_section_items, detection_radar_cross_section_items, count);
+        ofxXeThruLists::copy(message.detection_velocity_items, detection_velocity_items, count);
+    }
+};
+
+static_assert(std::is_trivially_copyable<ofxXeThruPresenceMovingList<>>::value, "ring and shared memory safe");
+static_assert(std::is_trivially_copyable<ofxXeThruRespirationMovingList<>>::value, "ring and shared memory safe");
+static_assert(std::is_trivially_copyable<ofxXeThruRespirationDetectionList<>>::value, "ring and shared memory safe");
+
+class ofxXeThruListReader {
+
+public:
+
+    // library side items reserved up front, more than the fixed
+    // capacities so cut messages don't grow the vectors either
+    ofxXeThruListReader(size_t reserve = 256){
+        for (std::vector<float> * items : {&presence.movement_slow_items, &presence.movement_fast_items,
+                &presence.detection_distance_items, &presence.radar_cross_section_items,
+                &presence.detection_velocity_items, &moving.movement_slow_items, &moving.movement_fast_items,
+                &detection.detection_distance_items, &detection.detection_radar_cross_section_items,
+                &detection.detection_velocity_items}) {
+            items->reserve(reserve);
+        }
+    }
+
+    // blocking like the read_message_*() call, 0 on success
+    template<size_t Capacity>
+    int read(XeThru::X4M300 & module, ofxXeThruPresenceMovingList<Capacity> & list){
+        const int status = module.read_message_presence_movinglist(&presence);
+        if (status == 0) {
+            list.assign(presence);
+        }
+        return status;
+    }
+
+    template<size_t Capacity>
+    int read(XeThru::X4M200 & module, ofxXeThruRespirationMovingList<Capacity> & list){
+        const int status = module.read_message_respiration_movinglist(&moving);
+        if (status == 0) {
+            list.assign(moving);
+        }
+        return status;
+    }
+
+    template<size_t Capacity>
+    int read(XeThru::X4M200 & module, ofxXeThruRespirationDetectionList<Capacity> & list){
+        const int status = module.read_message_respiration_detectionlist(&detection);
+        if (status == 0) {
+            list.assign(detection);
+        }
+        return status;
+    }
+
+private:
+
+    XeThru::PresenceMovingListData presence;
+    XeThru::RespirationMovingListData moving;
+    XeThru::RespirationDetectionListData detection;
+};
@@ -0,0 +1,179 @@
+//
+//  ofxXeThruManager.h
+//  Runs several XeThru modules from one process. Every sensor opens,
+//  configures and reads on its own ofxXeThru thread, so N modules start up
+//  in parallel instead of one blocking x4driver_init() after the other.
+//
+
+#pragma once
+
+#include "ofxXeThru.h"
+#include "ofxXeThruSync.h"
+#include "ofxXeThruFileTransfer.h"
+
+#include <dirent.h>
+
+#include <chrono>
+#include <future>
+
+class ofxXeThruManager {
+
+public:
+
+    ~ofxXeThruManager(){
+        stop();
+    }
+
+    // device files in /dev whose name starts with prefix, sorted so the
+    // same module keeps its device id across runs
+    static std::vector<std::string> listDevices(const std::string & prefix = "cu.usbmodem"){
+        std::vector<std::string> devices;
+        DIR * dir = opendir("/dev");
+        if (dir == nullptr) {
+            return devices;
+        }
+        while (dirent * entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name.compare(0, prefix.size(), prefix) == 0) {
+                devices.push_back("/dev/" + name);
+            }
+        }
+        closedir(dir);
+        std::sort(devices.begin(), devices.end());
+        return devices;
+    }
+
+    // every module found by listDevices()
+    void setup(){
+        setup(listDevices());
+    }
+
+    // device ids are the positions in devices
+    void setup(const std::vector<std::string> & devices){
+        stop();
+        sensors.clear();
+        next_sensor = 0;
+        for (size_t i = 0; i < devices.size(); ++i) {
+            sensors.emplace_back(new ofxXeThru());
+        }
+        // all threads are started before any of them finishes opening,
+        // so connect and init overlap across modules
+        for (size_t i = 0; i < devices.size(); ++i) {
+            sensors[i]->setup(devices[i], (int)i);
+        }
+        ofLogNotice("ofxXeThruManager") << "starting " << sensors.size() << " sensors";
+    }
+
+    void stop(){
+        for (auto & sensor : sensors) {
+            sensor->stopThread();
+        }
+        for (auto & sensor : sensors) {
+            sensor->stop();
+        }
+    }
+
+    size_t size() const {
+        return sensors.size();
+    }
+
+    size_t getNumConnected() const {
+        size_t count = 0;
+        for (auto & sensor : sensors) {
+            if (sensor->isConnected()) {
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    ofxXeThru & getSensor(size_t deviceID){
+        return *sensors[deviceID];
+    }
+
+    // next queued frame from any sensor, taken round robin so one busy
+    // module can't starve the others. frame.device_id says which one.
+    bool getNextFrame(ofxXeThruFrame & frame){
+        for (size_t n = 0; n < sensors.size(); ++n) {
+            ofxXeThru & sensor = *sensors[next_sensor];
+            next_sensor = (next_sensor + 1) % sensors.size();
+            if (sensor.getNextFrame(frame)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Aligns the sensors for getNextSuperFrame(). Call after setup(). Every
+    // sensor pings its module every ping_interval seconds so modules on
+    // slower links are lined up with the rest.
+    void setupSync(size_t bins, float fps, size_t depth = 4, float ping_interval = 5){
+        sync.setup(sensors.size(), bins, fps, depth);
+        for (auto & sensor : sensors) {
+            sensor->setPingInterval(ping_interval);
+        }
+    }
+
+    // Drains every sensor's queue into the sync and returns the next
+    // super-frame due. Use instead of getNextFrame(), not next to it.
+    bool getNextSuperFrame(ofxXeThruSuperFrame & frame){
+        for (size_t s = 0; s < sensors.size() && s < sync.getNumSensors(); ++s) {
+            sync.setLinkLatency(s, sensors[s]->getPingRoundTrip() / 2.0);
+        }
+        while (getNextFrame(incoming)) {
+            sync.addFrame(incoming);
+        }
+        return sync.getNextSuperFrame(ofGetElapsedTimeMicros(), frame);
+    }
+
+    // Runs job(xep, device id) on every sensor's acquisition thread at
+    // once and waits for all of them, so a fleet takes as long as its
+    // slowest module. A sensor that is reconnecting runs it once it is
+    // back; one that hasn't started the job within timeout_ms gets it
+    // cancelled and a result of 1. A job that has started is waited for,
+    // its XEP calls time out on their own. job runs on several threads at
+    // the same time. Results by device id, 0 on success like job's.
+    std::vector<int> runOnModules(std::function<int(XEP &, int)> job, uint64_t timeout_ms = 30000){
+        std::vector<std::future<int>> pending;
+        std::vector<uint64_t> ids(sensors.size(), 0);
+        for (size_t s = 0; s < sensors.size(); ++s) {
+            const int id = sensors[s]->getDeviceID();
+            pending.push_back(sensors[s]->runOnModule([job, id](XEP & xep){ return job(xep, id); }, &ids[s]));
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        std::vector<int> results;
+        for (size_t s = 0; s < sensors.size(); ++s) {
+            if (pending[s].wait_until(deadline) == std::future_status::timeout && sensors[s]->cancelJob(ids[s])) {
+                ofLogWarning("ofxXeThruManager") << sensors[s]->getDeviceName() << " did not get to the job in time";
+            }
+            results.push_back(pending[s].get());
+        }
+        return results;
+    }
+
+    // the same module file off every sensor, files[device id]. progress
+    // gets the device id too and is called from the sensor threads.
+    std::vector<int> readFiles(uint32_t type, uint32_t identifier, std::vector<Bytes> & files,
+        std::function<bool(int, size_t, size_t)> progress = nullptr, uint64_t timeout_ms = 30000){
+        files.resize(sensors.size());
+        return runOnModules([&files, type, identifier, progress](XEP & xep, int id){
+            ofxXeThruFileTransfer transfer;
+            return transfer.read(xep, type, identifier, files[id], [&progress, id](size_t done, size_t total){
+                return !progress || progress(id, done, total);
+            });
+        }, timeout_ms);
+    }
+
+    // clock offset, period and drift of every sensor
+    const ofxXeThruSync & getSync() const {
+        return sync;
+    }
+
+private:
+
+    ofxXeThruSync sync;
+    ofxXeThruFrame incoming;
+
+    std::vector<std::unique_ptr<ofxXeThru>> sensors;
+    size_t next_sensor = 0;
+};
@@ -0,0 +1,506 @@
+//
+//  ofxXeThruMappedReader.h
+//  Memory-mapped, zero-copy reader for recordings made by DataRecorder.
+//
+//  On first open the recording is read once through DataReader and every
+//  record is found, byte for byte, in the data files DataRecorder wrote.
+//  A sidecar next to the meta file keeps only the index: the data files
+//  with their sizes, then (file, offset, size, data type, epoch) per
+//  record. Every later open maps the sidecar and the data files as they
+//  are, read_record() returns views into the data file mappings, and
+//  seek_ms() and set_filter() are binary searches on per data type index
+//  lists. Views point wherever the record is on disk, so they are not
+//  necessarily aligned.
+//
+//  A record that can't be found in a data file, should DataReader ever
+//  hand out something it didn't read verbatim, is copied into the sidecar
+//  instead, so a view always holds what DataReader returned.
+//
+//  The method names follow DataReader so it can stand in for one.
+//
+
+#pragma once
+
+#include "DataReader.hpp"
+#include "ofxXeThruRecord.h"
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+class ofxXeThruMappedReader {
+
+public:
+
+    ~ofxXeThruMappedReader(){
+        close();
+    }
+
+    // sidecar written next to the meta file
+    static std::string get_index_filename(const std::string & meta_filename){
+        return meta_filename + ".xtindex";
+    }
+
+    // indexes the recording into the sidecar, replacing an existing one
+    static int build_index(const std::string & meta_filename){
+        XeThru::DataReader reader;
+        if (reader.open(meta_filename)) {
+            return 1;
+        }
+        const std::string folder = get_folder(meta_filename);
+        const std::string filename = get_index_filename(meta_filename);
+        const std::string temporary = filename + ".tmp";
+
+        // every file of the recording, split ones in subfolders included
+        std::vector<DataFile> files;
+        list_files(folder, "", files);
+        std::vector<Mapping> mappings(files.size());
+        std::vector<uint64_t> watermarks(files.size(), 0);
+        for (size_t f = 0; f < files.size(); ++f) {
+            mappings[f].map(folder + files[f].name);
+        }
+        auto unmapAll = [&mappings]{
+            for (Mapping & mapping : mappings) {
+                mapping.unmap();
+            }
+        };
+
+        FILE * file = std::fopen(temporary.c_str(), "wb");
+        if (file == nullptr) {
+            unmapAll();
+            return 1;
+        }
+        Header header;
+        std::memcpy(header.magic, "XTIX", 4);
+        header.version = version;
+        header.start_epoch = reader.get_start_epoch();
+        header.duration = reader.get_duration();
+        header.recording_size = reader.get_size();
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+
+        std::vector<uint8_t> buffer(reader.get_max_record_size());
+        std::vector<Entry> entries;
+        // file of the last record of each type, tried first
+        std::vector<uint32_t> last_file(type_count, 0);
+        uint64_t offset = sizeof(header);
+        const uint8_t padding[alignment] = {};
+        while (ok && !reader.at_end()) {
+            Entry entry;
+            uint32_t size = 0;
+            uint8_t is_user_header = 0;
+            if (reader.read_record(buffer.data(), buffer.size(), &size,
+                                   &entry.data_type, &entry.epoch, &is_user_header)) {
+                ok = false;
+                break;
+            }
+            entry.size = size;
+            entry.is_user_header = is_user_header;
+            const size_t slot = type_slot(entry.data_type);
+            if (locate(mappings, watermarks, last_file[slot], buffer.data(), size, entry.file, entry.offset)) {
+                last_file[slot] = entry.file;
+            } else {
+                entry.file = copied;
+                entry.offset = offset;
+                const size_t pad = (alignment - size % alignment) % alignment;
+                ok = std::fwrite(buffer.data(), 1, size, file) == size &&
+                    std::fwrite(padding, 1, pad, file) == pad;
+                offset += size + pad;
+            }
+            entries.push_back(entry);
+        }
+        unmapAll();
+
+        header.file_count = files.size();
+        header.files_offset = offset;
+        header.record_count = entries.size();
+        header.index_offset = offset + files.size() * sizeof(DataFile);
+        ok = ok && std::fwrite(files.data(), sizeof(DataFile), files.size(), file) == files.size();
+        ok = ok && std::fwrite(entries.data(), sizeof(Entry), entries.size(), file) == entries.size();
+        ok = ok && std::fseek(file, 0, SEEK_SET) == 0 && std::fwrite(&header, sizeof(header), 1, file) == 1;
+        ok = std::fclose(file) == 0 && ok;
+        if (!ok || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+            std::remove(temporary.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    // maps the sidecar, building it first if it's missing or stale
+    int open(const std::string & meta_filename){
+        close();
+        const std::string filename = get_index_filename(meta_filename);
+        if (map(meta_filename) && !is_current(meta_filename)) {
+            close();
+        }
+        if (!is_open()) {
+            if (build_index(meta_filename) || !map(meta_filename)) {
+                close();
+                return 1;
+            }
+        }
+
+        // one ordered list of record numbers per data type
+        for (size_t t = 0; t < type_count; ++t) {
+            by_type[t].clear();
+        }
+        for (uint64_t n = 0; n < count; ++n) {
+            by_type[type_slot(entries[n].data_type)].push_back(n);
+        }
+        // from the start of this file, whatever was read before
+        std::fill(cursor, cursor + type_count, 0);
+        read_position = 0;
+        filter = XeThru::AllDataTypes;
+        return 0;
+    }
+
+    bool is_open() const {
+        return index.address != nullptr;
+    }
+
+    void close(){
+        index.unmap();
+        for (Mapping & mapping : data_files) {
+            mapping.unmap();
+        }
+        data_files.clear();
+        header = nullptr;
+        entries = nullptr;
+        count = 0;
+    }
+
+    bool at_end() const {
+        return next_slot() == type_count;
+    }
+
+    // view into a data file mapping, valid until close()
+    int read_record(ofxXeThruRecord & record){
+        if (peek_record(record)) {
+            return 1;
+        }
+        const size_t slot = next_slot();
+        read_position = by_type[slot][cursor[slot]] + 1;
+        ++cursor[slot];
+        return 0;
+    }
+
+    int peek_record(ofxXeThruRecord & record) const {
+        const size_t slot = next_slot();
+        if (slot == type_count) {
+            return 1;
+        }
+        record = get_record(by_type[slot][cursor[slot]]);
+        return 0;
+    }
+
+    // position in ms from the start of the recording, O(log n) per type
+    int seek_ms(int64_t position){
+        if (!is_open()) {
+            return 1;
+        }
+        const int64_t epoch = header->start_epoch + position;
+        for (size_t t = 0; t < type_count; ++t) {
+            const std::vector<uint64_t> & list = by_type[t];
+            cursor[t] = std::lower_bound(list.begin(), list.end(), epoch,
+                [this](uint64_t n, int64_t value){ return entries[n].epoch < value; }) - list.begin();
+        }
+        // the first record of any type from there on
+        read_position = count;
+        for (size_t t = 0; t < type_count; ++t) {
+            if (cursor[t] < by_type[t].size()) {
+                read_position = std::min(read_position, by_type[t][cursor[t]]);
+            }
+        }
+        return 0;
+    }
+
+    // Keeps the read position: types that stay selected keep their
+    // cursors, types that come in start after the last record read, so
+    // nothing is delivered twice.
+    int set_filter(uint32_t data_types){
+        if (!is_open()) {
+            filter = data_types;
+            return 1;
+        }
+        for (size_t t = 0; t < type_count; ++t) {
+            if (is_selected(t, data_types) && !is_selected(t, filter)) {
+                const std::vector<uint64_t> & list = by_type[t];
+                cursor[t] = std::lower_bound(list.begin(), list.end(), read_position) - list.begin();
+            }
+        }
+        filter = data_types;
+        return 0;
+    }
+
+    uint32_t get_filter() const {
+        return filter;
+    }
+
+    int64_t get_start_epoch() const {
+        return header ? header->start_epoch : 0;
+    }
+
+    int64_t get_duration() const {
+        return header ? header->duration : 0;
+    }
+
+    // random access, in recording order, ignores the filter
+    uint64_t get_record_count() const {
+        return count;
+    }
+
+    uint64_t get_record_count(uint32_t data_type) const {
+        return by_type[type_slot(data_type)].size();
+    }
+
+    ofxXeThruRecord get_record(uint64_t n) const {
+        ofxXeThruRecord record;
+        const Entry & entry = entries[n];
+        const Mapping & mapping = entry.file == copied ? index : data_files[entry.file];
+        record.data = static_cast<const uint8_t *>(mapping.address) + entry.offset;
+        record.size = entry.size;
+        record.data_type = entry.data_type;
+        record.epoch = entry.epoch;
+        record.is_user_header = entry.is_user_header != 0;
+        return record;
+    }
+
+private:
+
+    static const uint32_t version = 2;
+    static const size_t alignment = 8;
+    // bytes past the end of the last record a record may start at
+    static const uint64_t search_window = 256;
+    // one slot per DataType bit, plus one for anything else
+    static const size_t type_count = 33;
+
+    struct Header {
+        char magic[4];
+        uint32_t version = 0;
+        uint64_t record_count = 0;
+        uint64_t index_offset = 0;
+        int64_t start_epoch = 0;
+        int64_t duration = 0;
+        int64_t recording_size = 0;
+        uint64_t file_count = 0;
+        uint64_t files_offset = 0;
+    };
+
+    // relative to the meta file's folder, size and mtime tell a stale index
+    struct DataFile {
+        char name[256] = {};
+        uint64_t size = 0;
+        int64_t mtime = 0;
+    };
+
+    // Entry::file of a record copied into the sidecar
+    static const uint32_t copied = 0xffffffffu;
+
+    struct Entry {
+        uint64_t offset = 0;
+        uint32_t size = 0;
+        uint32_t data_type = 0;
+        int64_t epoch = 0;
+        uint32_t is_user_header = 0;
+        // index into the data files, or copied
+        uint32_t file = copied;
+    };
+
+    struct Mapping {
+        void * address = nullptr;
+        size_t size = 0;
+
+        bool map(const std::string & filename){
+            unmap();
+            const int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) != 0 || info.st_size == 0) {
+                ::close(fd);
+                return false;
+            }
+            void * result = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+            if (result == MAP_FAILED) {
+                return false;
+            }
+            address = result;
+            size = info.st_size;
+            return true;
+        }
+
+        void unmap(){
+            if (address != nullptr) {
+                munmap(address, size);
+            }
+            address = nullptr;
+            size = 0;
+        }
+    };
+
+    static std::string get_folder(const std::string & meta_filename){
+        const size_t slash = meta_filename.find_last_of('/');
+        return slash == std::string::npos ? std::string("./") : meta_filename.substr(0, slash + 1);
+    }
+
+    // regular files under folder + relative, sidecars left out
+    static void list_files(const std::string & folder, const std::string & relative, std::vector<DataFile> & files){
+        DIR * dir = opendir((folder + relative).c_str());
+        if (dir == nullptr) {
+            return;
+        }
+        while (dirent * item = readdir(dir)) {
+            const std::string name = item->d_name;
+            if (name == "." || name == ".." || name.find(".xtindex") != std::string::npos) {
+                continue;
+            }
+            const std::string path = relative + name;
+            struct stat info;
+            if (stat((folder + path).c_str(), &info) != 0) {
+                continue;
+            }
+            if (S_ISDIR(info.st_mode)) {
+                list_files(folder, path + "/", files);
+            } else if (S_ISREG(info.st_mode) && info.st_size > 0 && path.size() < sizeof(DataFile::name)) {
+                DataFile file;
+                std::memcpy(file.name, path.c_str(), path.size());
+                file.size = info.st_size;
+                file.mtime = info.st_mtime;
+                files.push_back(file);
+            }
+        }
+        closedir(dir);
+    }
+
+    // DataRecorder writes records in order with a small header of its own
+    // in front, so a record is just past where the last one in its file
+    // ended. Looked for in a short window there, in hint first.
+    static bool locate(const std::vector<Mapping> & mappings, std::vector<uint64_t> & watermarks, uint32_t hint,
+                       const uint8_t * data, uint32_t size, uint32_t & file, uint64_t & offset){
+        if (size == 0) {
+            return false;
+        }
+        for (size_t n = 0; n <= mappings.size(); ++n) {
+            const size_t f = n == 0 ? hint : n - 1;
+            if (f >= mappings.size() || (n > 0 && f == hint) || mappings[f].address == nullptr) {
+                continue;
+            }
+            const uint8_t * base = static_cast<const uint8_t *>(mappings[f].address);
+            const uint64_t start = watermarks[f];
+            const uint64_t window = std::min<uint64_t>(mappings[f].size - start, uint64_t(size) + search_window);
+            if (window < size) {
+                continue;
+            }
+            const void * found = memmem(base + start, window, data, size);
+            if (found != nullptr) {
+                file = f;
+                offset = static_cast<const uint8_t *>(found) - base;
+                watermarks[f] = offset + size;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static size_t type_slot(uint32_t data_type){
+        for (size_t bit = 0; bit < 32; ++bit) {
+            if (data_type == (1u << bit)) {
+                return bit;
+            }
+        }
+        return 32;
+    }
+
+    // the sidecar of meta_filename and the data files it lists
+    bool map(const std::string & meta_filename){
+        if (!index.map(get_index_filename(meta_filename)) || index.size < sizeof(Header)) {
+            close();
+            return false;
+        }
+        const uint8_t * base = static_cast<const uint8_t *>(index.address);
+        header = reinterpret_cast<const Header *>(base);
+        const bool valid = std::memcmp(header->magic, "XTIX", 4) == 0 &&
+            header->version == version &&
+            header->files_offset + header->file_count * sizeof(DataFile) <= index.size &&
+            header->index_offset + header->record_count * sizeof(Entry) <= index.size;
+        if (!valid) {
+            close();
+            return false;
+        }
+        const DataFile * files = reinterpret_cast<const DataFile *>(base + header->files_offset);
+        entries = reinterpret_cast<const Entry *>(base + header->index_offset);
+        count = header->record_count;
+
+        // a data file that changed size or time since means a stale index
+        const std::string folder = get_folder(meta_filename);
+        data_files.resize(header->file_count);
+        for (uint64_t f = 0; f < header->file_count; ++f) {
+            struct stat info;
+            const std::string path = folder + std::string(files[f].name, strnlen(files[f].name, sizeof(files[f].name)));
+            if (stat(path.c_str(), &info) != 0 || uint64_t(info.st_size) != files[f].size ||
+                int64_t(info.st_mtime) != files[f].mtime || !data_files[f].map(path)) {
+                close();
+                return false;
+            }
+        }
+        for (uint64_t n = 0; n < count; ++n) {
+            const Entry & entry = entries[n];
+            const size_t available = entry.file == copied ? index.size :
+                entry.file < data_files.size() ? data_files[entry.file].size : 0;
+            if (entry.offset + entry.size > available) {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // only the meta file is opened, which is cheap
+    bool is_current(const std::string & meta_filename) const {
+        XeThru::DataReader reader;
+        return reader.open(meta_filename) == 0 &&
+            reader.get_size() == header->recording_size &&
+            reader.get_start_epoch() == header->start_epoch &&
+            reader.get_duration() == header->duration;
+    }
+
+    // slot 32 holds the types without a bit of their own
+    static bool is_selected(size_t t, uint32_t data_types){
+        return t < 32 ? (data_types & (1u << t)) != 0 : data_types == XeThru::AllDataTypes;
+    }
+
+    // the selected type whose next record comes first
+    size_t next_slot() const {
+        size_t best = type_count;
+        for (size_t t = 0; t < type_count; ++t) {
+            if (!is_selected(t, filter) || cursor[t] >= by_type[t].size()) {
+                continue;
+            }
+            if (best == type_count || by_type[t][cursor[t]] < by_type[best][cursor[best]]) {
+                best = t;
+            }
+        }
+        return best;
+    }
+
+    Mapping index;
+    std::vector<Mapping> data_files;
+    const Header * header = nullptr;
+    const Entry * entries = nullptr;
+    uint64_t count = 0;
+
+    uint32_t filter = XeThru::AllDataTypes;
+    std::vector<uint64_t> by_type[type_count];
+    size_t cursor[type_count] = {};
+    // record number after the last one read, in recording order
+    uint64_t read_position = 0;
+};
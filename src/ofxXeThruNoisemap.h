@@ -0,0 +1,371 @@
+//
+//  ofxXeThruNoisemap.h
+//  Host side noisemap cache for X4M200/X4M300 modules, keyed by serial
+//  number, so a module that was reset or swapped into a rig it has seen
+//  before starts from its learned noisemap instead of adapting from
+//  scratch.
+//
+//  capture() runs once a module has settled: it reads one full
+//  NoiseMapFloatData matrix off the noisemap stream as the host copy, has
+//  the module store its noisemap and pulls the stored file, chunked by
+//  ofxXeThruFileTransfer. restore() pushes that file back and sets
+//  the noisemap control to load the stored map rather than initialise a
+//  new one. The file goes back byte for byte: its layout is the
+//  firmware's, the host copy is for inspection and checks, not for
+//  rebuilding it.
+//
+//  The firmware doesn't publish the file type of the stored noisemap.
+//  capture() finds it as the file store_noisemap() created, and later
+//  captures reuse what was found, or setFileType() when it is known.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include "XEP.hpp"
+#include "Data.hpp"
+#include "xtid.h"
+
+#include "ofxXeThruFileTransfer.h"
+
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+struct ofxXeThruNoisemap {
+    std::string serial;
+    // the module's stored noisemap, as read off the module
+    uint32_t file_type = 0;
+    uint32_t file_identifier = 0;
+    Bytes file;
+    // one message per range bin and pulse-Doppler instance, in that order
+    std::vector<XeThru::PulseDopplerFloatData> bins;
+
+    // "XTNM", version, serial, file type, identifier and bytes, then the
+    // bins field by field in PulseDopplerFloatData order, host endian.
+    // Not NoiseMapFloatDataType records: that layout is unconfirmed and
+    // this file shouldn't change when it is. 0 on success.
+    int save(const std::string & filename) const {
+        FILE * f = std::fopen(filename.c_str(), "wb");
+        if (f == nullptr) {
+            return 1;
+        }
+        const uint32_t header[2] = {magic, version};
+        bool ok = std::fwrite(header, sizeof(header), 1, f) == 1 && writeBytes(f, serial.data(), serial.size()) &&
+            std::fwrite(&file_type, sizeof(file_type), 1, f) == 1 &&
+            std::fwrite(&file_identifier, sizeof(file_identifier), 1, f) == 1 && writeBytes(f, file.data(), file.size());
+        const uint32_t count = bins.size();
+        ok = ok && std::fwrite(&count, sizeof(count), 1, f) == 1;
+        for (const XeThru::PulseDopplerFloatData & bin : bins) {
+            ok = ok && writeBin(f, bin);
+        }
+        return (std::fclose(f) == 0 && ok) ? 0 : 1;
+    }
+
+    int load(const std::string & filename){
+        FILE * f = std::fopen(filename.c_str(), "rb");
+        if (f == nullptr) {
+            return 1;
+        }
+        uint32_t header[2];
+        Bytes text;
+        uint32_t count = 0;
+        bool ok = std::fread(header, sizeof(header), 1, f) == 1 && header[0] == magic && header[1] == version &&
+            readBytes(f, text) && std::fread(&file_type, sizeof(file_type), 1, f) == 1 &&
+            std::fread(&file_identifier, sizeof(file_identifier), 1, f) == 1 && readBytes(f, file) &&
+            std::fread(&count, sizeof(count), 1, f) == 1;
+        serial.assign(text.begin(), text.end());
+        bins.clear();
+        for (uint32_t i = 0; ok && i < count; ++i) {
+            bins.emplace_back();
+            ok = readBin(f, bins.back());
+        }
+        std::fclose(f);
+        return ok ? 0 : 1;
+    }
+
+private:
+
+    static const uint32_t magic = 0x4d4e5458; // "XTNM"
+    static const uint32_t version = 2;
+    // a stored noisemap is a few kB, anything far beyond is a bad file
+    static const uint32_t max_bytes = 16 << 20;
+
+    static bool writeBytes(FILE * f, const void * data, size_t size){
+        const uint32_t length = size;
+        return std::fwrite(&length, sizeof(length), 1, f) == 1 && (size == 0 || std::fwrite(data, size, 1, f) == 1);
+    }
+
+    static bool readBytes(FILE * f, Bytes & data){
+        uint32_t length = 0;
+        if (std::fread(&length, sizeof(length), 1, f) != 1 || length > max_bytes) {
+            return false;
+        }
+        data.resize(length);
+        return length == 0 || std::fread(data.data(), length, 1, f) == 1;
+    }
+
+    static bool writeBin(FILE * f, const XeThru::PulseDopplerFloatData & bin){
+        const uint32_t words[6] = {bin.frame_counter, bin.matrix_counter, bin.range_idx, bin.range_bins,
+            uint32_t(bin.data.size()), bin.pulsedoppler_instance};
+        const float floats[5] = {bin.fps, bin.fps_decimated, bin.frequency_start, bin.frequency_step, bin.range};
+        return std::fwrite(words, sizeof(words), 1, f) == 1 && std::fwrite(floats, sizeof(floats), 1, f) == 1 &&
+            (bin.data.empty() || std::fwrite(bin.data.data(), sizeof(float), bin.data.size(), f) == bin.data.size());
+    }
+
+    static bool readBin(FILE * f, XeThru::PulseDopplerFloatData & bin){
+        uint32_t words[6];
+        float floats[5];
+        if (std::fread(words, sizeof(words), 1, f) != 1 || std::fread(floats, sizeof(floats), 1, f) != 1 ||
+            words[4] > max_bytes / sizeof(float)) {
+            return false;
+        }
+        bin.frame_counter = words[0];
+        bin.matrix_counter = words[1];
+        bin.range_idx = words[2];
+        bin.range_bins = words[3];
+        bin.frequency_count = words[4];
+        bin.pulsedoppler_instance = words[5];
+        bin.fps = floats[0];
+        bin.fps_decimated = floats[1];
+        bin.frequency_start = floats[2];
+        bin.frequency_step = floats[3];
+        bin.range = floats[4];
+        bin.data.resize(words[4]);
+        return bin.data.empty() || std::fread(bin.data.data(), sizeof(float), bin.data.size(), f) == bin.data.size();
+    }
+};
+
+class ofxXeThruNoisemapCache {
+
+public:
+
+    // one <serial>.xtnm per module in directory, relative to the data folder
+    void setup(const std::string & _directory = "noisemaps"){
+        directory = ofToDataPath(_directory, true);
+        ofDirectory::createDirectory(directory, false, true);
+        std::lock_guard<std::mutex> guard(mutex);
+        noisemaps.clear();
+    }
+
+    // the stored noisemap's file type and identifier, when known for the
+    // firmware, so capture() doesn't have to find it
+    void setFileType(uint32_t type, uint32_t identifier){
+        std::lock_guard<std::mutex> guard(mutex);
+        file_type = type;
+        file_identifier = identifier;
+        file_known = true;
+    }
+
+    // XTID_SSIC_SERIALNUMBER, empty when the module doesn't answer
+    template<typename Module>
+    static std::string getSerial(Module & module){
+        std::string serial;
+        if (module.get_system_info(XTID_SSIC_SERIALNUMBER, &serial)) {
+            serial.clear();
+        }
+        return serial;
+    }
+
+    // Once the module's noisemap has adapted, with the profile running:
+    // reads one full noisemap off the float stream, stores it on the
+    // module and caches the stored file under the serial. Blocks for up
+    // to timeout_ms while the matrix comes in. 0 on success.
+    template<typename Module>
+    int capture(Module & module, XeThru::XEP & xep, uint64_t timeout_ms = 10000){
+        ofxXeThruNoisemap noisemap;
+        noisemap.serial = getSerial(module);
+        if (noisemap.serial.empty()) {
+            ofLogError("ofxXeThruNoisemapCache") << "no serial number, not caching";
+            return 1;
+        }
+        if (readMatrix(module, timeout_ms, noisemap.bins)) {
+            ofLogError("ofxXeThruNoisemapCache") << "no complete noisemap from " << noisemap.serial;
+            return 1;
+        }
+        XeThru::Files before;
+        XeThru::Files after;
+        if (xep.find_all_files(before) || module.store_noisemap() || xep.find_all_files(after)) {
+            ofLogError("ofxXeThruNoisemapCache") << noisemap.serial << " could not store its noisemap";
+            return 1;
+        }
+        if (findFile(before, after, noisemap.file_type, noisemap.file_identifier)) {
+            ofLogError("ofxXeThruNoisemapCache") << "can't tell which file holds the noisemap of " << noisemap.serial
+                << ", set it with setFileType()";
+            return 1;
+        }
+        ofxXeThruFileTransfer transfer;
+        if (transfer.read(xep, noisemap.file_type, noisemap.file_identifier, noisemap.file) || noisemap.file.empty()) {
+            ofLogError("ofxXeThruNoisemapCache") << "could not read the stored noisemap of " << noisemap.serial;
+            return 1;
+        }
+        if (noisemap.save(getFilename(noisemap.serial))) {
+            ofLogError("ofxXeThruNoisemapCache") << "could not write " << getFilename(noisemap.serial);
+            return 1;
+        }
+        ofLogNotice("ofxXeThruNoisemapCache") << "cached the noisemap of " << noisemap.serial << ", "
+            << noisemap.file.size() << " bytes, " << noisemap.bins.size() << " bins";
+        std::lock_guard<std::mutex> guard(mutex);
+        file_type = noisemap.file_type;
+        file_identifier = noisemap.file_identifier;
+        file_known = true;
+        noisemaps[noisemap.serial] = std::move(noisemap);
+        return 0;
+    }
+
+    // Before the profile runs: pushes the cached noisemap of this module
+    // back and has the module use it, adapting on from there. 1 when
+    // there is none for its serial or the module refused it, the module
+    // then learns a new one as usual. Safe to call for several modules
+    // from their own threads.
+    template<typename Module>
+    int restore(Module & module, XeThru::XEP & xep){
+        const std::string serial = getSerial(module);
+        const ofxXeThruNoisemap * noisemap = serial.empty() ? nullptr : find(serial);
+        if (noisemap == nullptr) {
+            return 1;
+        }
+        ofxXeThruFileTransfer transfer;
+        if (transfer.write(xep, noisemap->file_type, noisemap->file_identifier, noisemap->file)) {
+            ofLogError("ofxXeThruNoisemapCache") << "could not write the noisemap of " << serial;
+            return 1;
+        }
+        // without INIT_ON_RESET the profile loads the stored map on start
+        if (module.set_noisemap_control(XTID_NOISEMAP_CONTROL_ENABLE | XTID_NOISEMAP_CONTROL_ADAPTIVE)) {
+            ofLogError("ofxXeThruNoisemapCache") << serial << " did not take the noisemap control";
+            return 1;
+        }
+        // not functional on every firmware, the control above is what counts
+        module.load_noisemap();
+        ofLogNotice("ofxXeThruNoisemapCache") << "restored the noisemap of " << serial;
+        return 0;
+    }
+
+    bool contains(const std::string & serial){
+        return find(serial) != nullptr;
+    }
+
+    // the cached noisemap of serial, read from disk on first use. nullptr
+    // when there is none. Stays valid until setup() or the next capture()
+    // of the same serial.
+    const ofxXeThruNoisemap * find(const std::string & serial){
+        std::lock_guard<std::mutex> guard(mutex);
+        auto found = noisemaps.find(serial);
+        if (found != noisemaps.end()) {
+            return &found->second;
+        }
+        ofxXeThruNoisemap noisemap;
+        if (noisemap.load(getFilename(serial)) || noisemap.serial != serial) {
+            return nullptr;
+        }
+        if (!file_known) {
+            file_type = noisemap.file_type;
+            file_identifier = noisemap.file_identifier;
+            file_known = true;
+        }
+        return &(noisemaps[serial] = std::move(noisemap));
+    }
+
+private:
+
+    std::string getFilename(const std::string & serial) const {
+        // serial numbers are alphanumeric but come straight off the wire
+        std::string name = serial;
+        for (char & c : name) {
+            if (!isalnum((unsigned char)c) && c != '-') {
+                c = '_';
+            }
+        }
+        return ofFilePath::join(directory, name + ".xtnm");
+    }
+
+    // One message per range bin of every pulse-Doppler instance. Reads
+    // until a bin comes round again with all instances seen complete.
+    template<typename Module>
+    static int readMatrix(Module & module, uint64_t timeout_ms, std::vector<XeThru::PulseDopplerFloatData> & bins){
+        std::map<std::pair<uint32_t, uint32_t>, XeThru::PulseDopplerFloatData> matrix;
+        std::map<uint32_t, uint32_t> range_bins;
+        if (module.set_output_control(XTS_ID_NOISEMAP_FLOAT, XTID_OUTPUT_CONTROL_ENABLE)) {
+            return 1;
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        XeThru::PulseDopplerFloatData message;
+        bool complete = false;
+        while (!complete && std::chrono::steady_clock::now() < deadline) {
+            if (module.peek_message_noisemap_float() <= 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (module.read_message_noisemap_float(&message)) {
+                continue;
+            }
+            const std::pair<uint32_t, uint32_t> key(message.pulsedoppler_instance, message.range_idx);
+            if (matrix.count(key)) {
+                complete = true;
+                for (const auto & instance : range_bins) {
+                    complete = complete && countBins(matrix, instance.first) >= instance.second;
+                }
+            }
+            range_bins[message.pulsedoppler_instance] = message.range_bins;
+            matrix[key] = message;
+        }
+        module.set_output_control(XTS_ID_NOISEMAP_FLOAT, XTID_OUTPUT_CONTROL_DISABLE);
+        if (!complete) {
+            return 1;
+        }
+        bins.clear();
+        for (auto & bin : matrix) {
+            bins.push_back(std::move(bin.second));
+        }
+        return 0;
+    }
+
+    static size_t countBins(const std::map<std::pair<uint32_t, uint32_t>, XeThru::PulseDopplerFloatData> & matrix, uint32_t instance){
+        auto first = matrix.lower_bound(std::make_pair(instance, 0u));
+        auto last = matrix.lower_bound(std::make_pair(instance + 1, 0u));
+        return std::distance(first, last);
+    }
+
+    // the file store_noisemap() created, else the one found before
+    int findFile(const XeThru::Files & before, const XeThru::Files & after, uint32_t & type, uint32_t & identifier){
+        std::vector<std::pair<int32_t, int32_t>> created;
+        for (size_t i = 0; i < after.file_type_items.size() && i < after.file_identifier_items.size(); ++i) {
+            bool existed = false;
+            for (size_t j = 0; j < before.file_type_items.size() && j < before.file_identifier_items.size(); ++j) {
+                existed = existed || (before.file_type_items[j] == after.file_type_items[i] &&
+                    before.file_identifier_items[j] == after.file_identifier_items[i]);
+            }
+            if (!existed) {
+                created.emplace_back(after.file_type_items[i], after.file_identifier_items[i]);
+            }
+        }
+        std::lock_guard<std::mutex> guard(mutex);
+        if (created.size() == 1) {
+            type = created[0].first;
+            identifier = created[0].second;
+            return 0;
+        }
+        if (file_known) {
+            type = file_type;
+            identifier = file_identifier;
+            return 0;
+        }
+        return 1;
+    }
+
+    std::string directory;
+
+    std::mutex mutex;
+    std::map<std::string, ofxXeThruNoisemap> noisemaps;
+    bool file_known = false;
+    uint32_t file_type = 0;
+    uint32_t file_identifier = 0;
+};
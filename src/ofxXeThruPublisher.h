@@ -0,0 +1,504 @@
+//
+//  ofxXeThruPublisher.h
+//  Fans frames out to other processes, so one process owns the serial
+//  ports and any number of consumers read at full rate.
+//
+//  Local consumers map a POSIX shared memory ring (shm_open) and copy out
+//  only the frames they read, the publisher writes each frame once no
+//  matter how many readers there are. Every slot is a seqlock, a reader
+//  that was lapped by the publisher notices and skips ahead instead of
+//  slowing it down. Remote consumers get one UDP multicast datagram per
+//  frame.
+//
+//  Both carry the device id, the module frame counter and the host
+//  receive time. Several sensors can share one publisher.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include "ofxXeThruFrame.h"
+#include "ofxXeThruTrace.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+namespace ofxXeThruPublishing {
+
+    static const uint32_t magic = 0x46555458; // "XTUF"
+    static const uint32_t version = 1;
+
+    // start of the shared memory, slots follow at 64 byte offsets
+    struct RingHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slots;
+        uint32_t max_bins;
+        uint64_t slot_size;
+        // frames published, the next one goes to slot head % slots
+        std::atomic<uint64_t> head;
+        uint8_t padding[32];
+    };
+
+    struct SlotHeader {
+        // 2n + 1 while frame n is written into the slot, 2n + 2 once done
+        std::atomic<uint64_t> sequence;
+        uint64_t timestamp;
+        uint32_t device_id;
+        uint32_t frame_counter;
+        uint32_t content_id;
+        uint32_t bins;
+    };
+
+    // UDP datagram, followed by bins floats, host byte order for the
+    // floats and network byte order for the rest
+    struct PacketHeader {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t device_id;
+        uint32_t frame_counter;
+        uint32_t bins;
+        uint64_t timestamp;
+    };
+
+    // largest UDP payload, anything longer is cut
+    static const size_t max_packet = 65507;
+
+    static size_t getSlotSize(uint32_t max_bins){
+        return (sizeof(SlotHeader) + max_bins * sizeof(float) + 63) & ~size_t(63);
+    }
+
+    static uint64_t swap64(uint64_t value){
+        return (uint64_t(ntohl(uint32_t(value))) << 32) | ntohl(uint32_t(value >> 32));
+    }
+
+    static uint64_t toNetwork64(uint64_t value){
+        return htonl(1) == 1 ? value : swap64(value);
+    }
+}
+
+class ofxXeThruPublisher {
+
+public:
+
+    ~ofxXeThruPublisher(){
+        close();
+    }
+
+    // Creates the ring /name (leading slash, up to 30 characters on macOS)
+    // with room for slots frames of up to max_bins floats. Readers that
+    // fall more than slots frames behind lose frames.
+    int openSharedMemory(const std::string & _name, uint32_t slots = 256, uint32_t max_bins = 2048){
+        closeSharedMemory();
+        const size_t slot_size = ofxXeThruPublishing::getSlotSize(max_bins);
+        const size_t size = sizeof(ofxXeThruPublishing::RingHeader) + slots * slot_size;
+        const int fd = shm_open(_name.c_str(), O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            ofLogError("ofxXeThruPublisher") << "could not create shared memory " << _name;
+            return 1;
+        }
+        if (ftruncate(fd, size)) {
+            ofLogError("ofxXeThruPublisher") << "could not size shared memory " << _name;
+            ::close(fd);
+            shm_unlink(_name.c_str());
+            return 1;
+        }
+        void * memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            ofLogError("ofxXeThruPublisher") << "could not map shared memory " << _name;
+            shm_unlink(_name.c_str());
+            return 1;
+        }
+        ring = static_cast<uint8_t *>(memory);
+        ring_size = size;
+        name = _name;
+
+        ofxXeThruPublishing::RingHeader * header = getHeader();
+        header->magic = 0;
+        header->version = ofxXeThruPublishing::version;
+        header->slots = slots;
+        header->max_bins = max_bins;
+        header->slot_size = slot_size;
+        header->head.store(0, std::memory_order_relaxed);
+        for (uint32_t s = 0; s < slots; ++s) {
+            getSlot(s)->sequence.store(0, std::memory_order_relaxed);
+        }
+        // readers check the magic last, once everything else is in place
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = ofxXeThruPublishing::magic;
+        return 0;
+    }
+
+    // group e.g. "239.0.0.1", ttl 1 keeps it on the local network
+    int openMulticast(const std::string & group, uint16_t port, int ttl = 1){
+        closeMulticast();
+        const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            ofLogError("ofxXeThruPublisher") << "could not create socket";
+            return 1;
+        }
+        const unsigned char hops = ttl;
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+        std::memset(&destination, 0, sizeof(destination));
+        destination.sin_family = AF_INET;
+        destination.sin_port = htons(port);
+        if (inet_pton(AF_INET, group.c_str(), &destination.sin_addr) != 1) {
+            ofLogError("ofxXeThruPublisher") << "invalid multicast group " << group;
+            ::close(fd);
+            return 1;
+        }
+        udp = fd;
+        return 0;
+    }
+
+    void close(){
+        closeSharedMemory();
+        closeMulticast();
+    }
+
+    // thread safe, call from every sensor's acquisition thread
+    void publish(const ofxXeThruFrame & frame){
+        OFXXETHRU_TRACE_SCOPE("ofxXeThruPublisher publish");
+        if (ring != nullptr) {
+            writeSlot(frame);
+        }
+        if (udp >= 0) {
+            sendPacket(frame);
+        }
+        ++published;
+    }
+
+    bool isOpen() const {
+        return ring != nullptr || udp >= 0;
+    }
+
+    uint64_t getPublishedFrames() const {
+        return published;
+    }
+
+    // frames cut to max_bins in the ring or to one datagram
+    uint64_t getTruncatedFrames() const {
+        return truncated;
+    }
+
+    uint64_t getSendErrors() const {
+        return send_errors;
+    }
+
+private:
+
+    ofxXeThruPublishing::RingHeader * getHeader(){
+        return reinterpret_cast<ofxXeThruPublishing::RingHeader *>(ring);
+    }
+
+    ofxXeThruPublishing::SlotHeader * getSlot(uint64_t n){
+        const ofxXeThruPublishing::RingHeader * header = getHeader();
+        return reinterpret_cast<ofxXeThruPublishing::SlotHeader *>(
+            ring + sizeof(ofxXeThruPublishing::RingHeader) + (n % header->slots) * header->slot_size);
+    }
+
+    void writeSlot(const ofxXeThruFrame & frame){
+        ofxXeThruPublishing::RingHeader * header = getHeader();
+        // claimed first so publishers on several threads get their own slot
+        const uint64_t n = header->head.fetch_add(1, std::memory_order_relaxed);
+        ofxXeThruPublishing::SlotHeader * slot = getSlot(n);
+        slot->sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        uint32_t bins = frame.data.size();
+        if (bins > header->max_bins) {
+            bins = header->max_bins;
+            ++truncated;
+        }
+        slot->timestamp = frame.timestamp;
+        slot->device_id = frame.device_id;
+        slot->frame_counter = frame.info;
+        slot->content_id = frame.content_id;
+        slot->bins = bins;
+        std::memcpy(reinterpret_cast<uint8_t *>(slot) + sizeof(*slot), frame.data.data(), bins * sizeof(float));
+
+        slot->sequence.store(2 * n + 2, std::memory_order_release);
+    }
+
+    void sendPacket(const ofxXeThruFrame & frame){
+        const size_t room = (ofxXeThruPublishing::max_packet - sizeof(ofxXeThruPublishing::PacketHeader)) / sizeof(float);
+        uint32_t bins = frame.data.size();
+        if (bins > room) {
+            bins = room;
+            ++truncated;
+        }
+        ofxXeThruPublishing::PacketHeader header;
+        header.magic = htonl(ofxXeThruPublishing::magic);
+        header.version = htons(ofxXeThruPublishing::version);
+        header.device_id = htons(frame.device_id);
+        header.frame_counter = htonl(frame.info);
+        header.bins = htonl(bins);
+        header.timestamp = ofxXeThruPublishing::toNetwork64(frame.timestamp);
+        // header and floats go out as one datagram without a copy
+        iovec parts[2];
+        parts[0].iov_base = &header;
+        parts[0].iov_len = sizeof(header);
+        parts[1].iov_base = const_cast<float *>(frame.data.data());
+        parts[1].iov_len = bins * sizeof(float);
+        msghdr message;
+        std::memset(&message, 0, sizeof(message));
+        message.msg_name = &destination;
+        message.msg_namelen = sizeof(destination);
+        message.msg_iov = parts;
+        message.msg_iovlen = 2;
+        if (sendmsg(udp, &message, 0) < 0) {
+            ++send_errors;
+        }
+    }
+
+    void closeSharedMemory(){
+        if (ring == nullptr) {
+            return;
+        }
+        munmap(ring, ring_size);
+        // readers keep their mapping, new ones can't open it any more
+        shm_unlink(name.c_str());
+        ring = nullptr;
+    }
+
+    void closeMulticast(){
+        if (udp >= 0) {
+            ::close(udp);
+            udp = -1;
+        }
+    }
+
+    std::string name;
+    uint8_t * ring = nullptr;
+    size_t ring_size = 0;
+
+    int udp = -1;
+    sockaddr_in destination;
+
+    std::atomic<uint64_t> published{0};
+    std::atomic<uint64_t> truncated{0};
+    std::atomic<uint64_t> send_errors{0};
+};
+
+// reads the frames of an ofxXeThruPublisher ring in another process
+class ofxXeThruSharedMemoryReader {
+
+public:
+
+    ~ofxXeThruSharedMemoryReader(){
+        close();
+    }
+
+    // reading starts at the newest frame
+    int open(const std::string & name){
+        close();
+        const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) {
+            ofLogError("ofxXeThruSharedMemoryReader") << "no shared memory " << name;
+            return 1;
+        }
+        struct stat info;
+        if (fstat(fd, &info) || size_t(info.st_size) < sizeof(ofxXeThruPublishing::RingHeader)) {
+            ofLogError("ofxXeThruSharedMemoryReader") << name << " is not a frame ring";
+            ::close(fd);
+            return 1;
+        }
+        void * memory = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (memory == MAP_FAILED) {
+            ofLogError("ofxXeThruSharedMemoryReader") << "could not map " << name;
+            return 1;
+        }
+        ring = static_cast<const uint8_t *>(memory);
+        ring_size = info.st_size;
+        const ofxXeThruPublishing::RingHeader * header = getHeader();
+        if (header->magic != ofxXeThruPublishing::magic || header->version != ofxXeThruPublishing::version ||
+            sizeof(ofxXeThruPublishing::RingHeader) + header->slots * header->slot_size > ring_size) {
+            ofLogError("ofxXeThruSharedMemoryReader") << name << " is not a frame ring";
+            close();
+            return 1;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        next = header->head.load(std::memory_order_acquire);
+        lost = 0;
+        return 0;
+    }
+
+    void close(){
+        if (ring != nullptr) {
+            munmap(const_cast<uint8_t *>(ring), ring_size);
+            ring = nullptr;
+        }
+    }
+
+    bool isOpen() const {
+        return ring != nullptr;
+    }
+
+    // Copies the next frame out, false when there is none yet. frame keeps
+    // its capacity, reserve it once to never allocate here.
+    bool getNextFrame(ofxXeThruFrame & frame){
+        if (ring == nullptr) {
+            return false;
+        }
+        const ofxXeThruPublishing::RingHeader * header = getHeader();
+        while (true) {
+            const uint64_t head = header->head.load(std::memory_order_acquire);
+            if (next >= head) {
+                return false;
+            }
+            // lapped, skip to the oldest frame still in the ring
+            if (head - next > header->slots) {
+                lost += head - header->slots - next;
+                next = head - header->slots;
+            }
+            const ofxXeThruPublishing::SlotHeader * slot = getSlot(next);
+            const uint64_t before = slot->sequence.load(std::memory_order_acquire);
+            if (before < 2 * next + 2) {
+                // claimed but still being written
+                return false;
+            }
+            if (before == 2 * next + 2) {
+                const uint32_t bins = std::min(slot->bins, header->max_bins);
+                frame.data.resize(bins);
+                std::memcpy(frame.data.data(), reinterpret_cast<const uint8_t *>(slot) + sizeof(*slot), bins * sizeof(float));
+                frame.timestamp = slot->timestamp;
+                frame.device_id = slot->device_id;
+                frame.info = slot->frame_counter;
+                frame.content_id = slot->content_id;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot->sequence.load(std::memory_order_relaxed) == before) {
+                    ++next;
+                    return true;
+                }
+            }
+            // overwritten while copying
+            ++lost;
+            ++next;
+        }
+    }
+
+    // frames the publisher overwrote before this reader got to them
+    uint64_t getLostFrames() const {
+        return lost;
+    }
+
+private:
+
+    const ofxXeThruPublishing::RingHeader * getHeader() const {
+        return reinterpret_cast<const ofxXeThruPublishing::RingHeader *>(ring);
+    }
+
+    const ofxXeThruPublishing::SlotHeader * getSlot(uint64_t n) const {
+        const ofxXeThruPublishing::RingHeader * header = getHeader();
+        return reinterpret_cast<const ofxXeThruPublishing::SlotHeader *>(
+            ring + sizeof(ofxXeThruPublishing::RingHeader) + (n % header->slots) * header->slot_size);
+    }
+
+    const uint8_t * ring = nullptr;
+    size_t ring_size = 0;
+    uint64_t next = 0;
+    uint64_t lost = 0;
+};
+
+// receives the multicast datagrams of an ofxXeThruPublisher
+class ofxXeThruMulticastReader {
+
+public:
+
+    ~ofxXeThruMulticastReader(){
+        close();
+    }
+
+    int open(const std::string & group, uint16_t port){
+        close();
+        const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0) {
+            ofLogError("ofxXeThruMulticastReader") << "could not create socket";
+            return 1;
+        }
+        const int reuse = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+#ifdef SO_REUSEPORT
+        // several readers on one host
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+#endif
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        ip_mreq membership;
+        std::memset(&membership, 0, sizeof(membership));
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (inet_pton(AF_INET, group.c_str(), &membership.imr_multiaddr) != 1 ||
+            bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) ||
+            setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership))) {
+            ofLogError("ofxXeThruMulticastReader") << "could not join " << group << ":" << port;
+            ::close(fd);
+            return 1;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        udp = fd;
+        packet.resize(ofxXeThruPublishing::max_packet);
+        return 0;
+    }
+
+    void close(){
+        if (udp >= 0) {
+            ::close(udp);
+            udp = -1;
+        }
+    }
+
+    // never blocks, poll() or select() getFileDescriptor() to wait
+    bool getNextFrame(ofxXeThruFrame & frame){
+        if (udp < 0) {
+            return false;
+        }
+        while (true) {
+            const ssize_t size = recv(udp, packet.data(), packet.size(), 0);
+            if (size < 0) {
+                return false;
+            }
+            ofxXeThruPublishing::PacketHeader header;
+            if (size_t(size) < sizeof(header)) {
+                continue;
+            }
+            std::memcpy(&header, packet.data(), sizeof(header));
+            const uint32_t bins = ntohl(header.bins);
+            if (ntohl(header.magic) != ofxXeThruPublishing::magic ||
+                ntohs(header.version) != ofxXeThruPublishing::version ||
+                size_t(size) != sizeof(header) + bins * sizeof(float)) {
+                continue;
+            }
+            frame.data.resize(bins);
+            std::memcpy(frame.data.data(), packet.data() + sizeof(header), bins * sizeof(float));
+            frame.device_id = ntohs(header.device_id);
+            frame.info = ntohl(header.frame_counter);
+            frame.timestamp = ofxXeThruPublishing::toNetwork64(header.timestamp);
+            return true;
+        }
+    }
+
+    int getFileDescriptor() const {
+        return udp;
+    }
+
+private:
+
+    int udp = -1;
+    Bytes packet;
+};
@@ -0,0 +1,22 @@
+//
+//  ofxXeThruRecord.h
+//  Non-owning view of one recording record. The bytes belong to whoever
+//  produced the view and are only valid for the duration of the callback or
+//  for as long as the producer says so.
+//
+
+#pragma once
+
+#include "datatypes.h"
+
+#include <cstdint>
+
+struct ofxXeThruRecord {
+    const uint8_t * data = nullptr;
+    uint32_t size = 0;
+    // a single XeThru::DataType flag
+    uint32_t data_type = XeThru::InvalidDataType;
+    // ms since 1970.01.01, as written by DataRecorder
+    int64_t epoch = 0;
+    bool is_user_header = false;
+};
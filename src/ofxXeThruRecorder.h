@@ -0,0 +1,254 @@
+//
+//  ofxXeThruRecorder.h
+//  Recording off the acquisition thread. Frames are copied into a bounded
+//  queue of preallocated records and a writer thread hands them to its own
+//  DataRecorder through process(), so a slow disk only ever fills the
+//  queue. When the queue is full the record is dropped and counted, the
+//  acquisition thread never waits on I/O.
+//
+//  File splitting and the file available callbacks are DataRecorder's own,
+//  set them up on getDataRecorder() and RecordingOptions as usual. The
+//  callbacks run on the writer thread.
+//
+//  Subclasses write somewhere else by overriding write() and finish(),
+//  see ofxXeThruColumnar::Recorder. They call stop() in their destructor.
+//
+
+#pragma once
+
+#include "ofMain.h"
+
+#include "DataRecorder.hpp"
+#include "RecordingOptions.hpp"
+#include "Data.hpp"
+
+#include "ofxXeThruDecoders.h"
+#include "ofxXeThruRingBuffer.h"
+#include "ofxXeThruSignal.h"
+#include "ofxXeThruTrace.h"
+
+#include <chrono>
+#include <cstring>
+
+class ofxXeThruRecorder : public ofThread {
+
+public:
+
+    ~ofxXeThruRecorder(){
+        stop();
+    }
+
+    // queue_size records of up to record_size bytes are allocated up front,
+    // larger records still work but grow their slot once
+    int start(XeThru::DataTypes data_types, const std::string & directory,
+              const XeThru::RecordingOptions & options = XeThru::RecordingOptions(),
+              size_t queue_size = 512, size_t record_size = 64 * 1024){
+        stop();
+        if (recorder.start_recording(data_types, directory, options)) {
+            ofLogError("ofxXeThruRecorder") << "could not start recording to " << directory;
+            return 1;
+        }
+        startWriter(data_types, queue_size, record_size);
+        return 0;
+    }
+
+    // writes what is still queued, then closes the files
+    void stop(){
+        if (!recording.exchange(false)) {
+            return;
+        }
+        waitForThread(true);
+        finish();
+    }
+
+    bool isRecording() const {
+        return recording;
+    }
+
+    // Producer side, from a single thread. Returns false when the record
+    // was dropped because the queue is full or nothing is being recorded.
+    bool push(XeThru::DataType data_type, const uint8_t * data, size_t size){
+        if (!recording || (recording_types & data_type) == 0) {
+            return false;
+        }
+        scratch.data_type = data_type;
+        scratch.bytes.assign(data, data + size);
+        return enqueue();
+    }
+
+    // encoded as their own record type, layouts in ofxXeThruDecoders.h
+    bool push(const XeThru::DataFloat & frame){
+        return encode<XeThru::FloatDataType>(frame);
+    }
+
+    bool push(const XeThru::BasebandApData & message){
+        return encode<XeThru::BasebandApDataType>(message);
+    }
+
+    bool push(const XeThru::BasebandIqData & message){
+        return encode<XeThru::BasebandIqDataType>(message);
+    }
+
+    // no pulse-Doppler push(), their record layout isn't confirmed yet,
+    // see ofxXeThruDecoders.h
+
+    // subscribe_to_file_available etc., before start()
+    XeThru::DataRecorder & getDataRecorder(){
+        return recorder;
+    }
+
+    // records waiting for the writer thread
+    size_t getQueueDepth() const {
+        return queue.size();
+    }
+
+    size_t getMaxQueueDepth() const {
+        return max_queue_depth;
+    }
+
+    size_t getQueueCapacity() const {
+        return queue.capacity();
+    }
+
+    // bytes written over the last second
+    float getBytesPerSecond() const {
+        return bytes_per_second;
+    }
+
+    uint64_t getWrittenRecords() const {
+        return written;
+    }
+
+    // rejected because the queue was full
+    uint64_t getDroppedRecords() const {
+        return dropped;
+    }
+
+    // rejected by DataRecorder::process(), or write() of a subclass
+    uint64_t getFailedRecords() const {
+        return failed;
+    }
+
+    // slowest single write, the I/O spikes the queue absorbed
+    uint64_t getMaxWriteMicros() const {
+        return max_write_micros;
+    }
+
+protected:
+
+    struct Record {
+        XeThru::DataType data_type = XeThru::FloatDataType;
+        // ms since 1970.01.01 when it was queued, as DataRecorder stamps it
+        int64_t epoch = 0;
+        Bytes bytes;
+    };
+
+    // allocates the queue and starts the writer thread
+    void startWriter(XeThru::DataTypes data_types, size_t queue_size, size_t record_size){
+        recording_types = data_types;
+        auto reserve = [record_size](Record & record){
+            record.bytes.reserve(record_size);
+        };
+        queue.allocate(queue_size, reserve);
+        reserve(scratch);
+        reserve(writing);
+
+        written = 0;
+        dropped = 0;
+        failed = 0;
+        max_queue_depth = 0;
+        max_write_micros = 0;
+        bytes_per_second = 0;
+        recording = true;
+        startThread();
+    }
+
+    // on the writer thread, false counts the record as failed
+    virtual bool write(const Record & record){
+        return recorder.process(record.data_type, record.bytes);
+    }
+
+    // after the last write(), on the thread that called stop()
+    virtual void finish(){
+        recorder.stop_recording(recording_types);
+    }
+
+private:
+
+    template<uint32_t Type>
+    bool encode(const typename ofxXeThruDecoders::Decoder<Type>::Data & message){
+        if (!recording || (recording_types & Type) == 0) {
+            return false;
+        }
+        scratch.data_type = XeThru::DataType(Type);
+        ofxXeThruDecoders::Decoder<Type>::encode(message, scratch.bytes);
+        return enqueue();
+    }
+
+    bool enqueue(){
+        scratch.epoch = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (!queue.push(scratch)) {
+            ++dropped;
+            return false;
+        }
+        queued.notify();
+        const size_t depth = queue.size();
+        if (depth > max_queue_depth) {
+            max_queue_depth = depth;
+        }
+        return true;
+    }
+
+    // drains everything that's queued on each wake, and the rest on stop
+    void threadedFunction(){
+        OFXXETHRU_TRACE_THREAD("ofxXeThruRecorder writer");
+        uint64_t rate_start = ofGetElapsedTimeMicros();
+        size_t rate_bytes = 0;
+
+        while (isThreadRunning() || !queue.empty()) {
+            if (!queue.pop(writing)) {
+                // woken by push(), the timeout is only there to see stop()
+                queued.wait(100, [this]{ return !queue.empty() || !isThreadRunning(); });
+            } else {
+                const uint64_t before = ofGetElapsedTimeMicros();
+                OFXXETHRU_TRACE_SCOPE("ofxXeThruRecorder::write");
+                if (write(writing)) {
+                    ++written;
+                    rate_bytes += writing.bytes.size();
+                } else {
+                    ++failed;
+                }
+                const uint64_t elapsed = ofGetElapsedTimeMicros() - before;
+                if (elapsed > max_write_micros) {
+                    max_write_micros = elapsed;
+                }
+            }
+
+            const uint64_t now = ofGetElapsedTimeMicros();
+            if (now - rate_start >= 1000000) {
+                bytes_per_second = rate_bytes * 1e6f / (now - rate_start);
+                rate_start = now;
+                rate_bytes = 0;
+            }
+        }
+        bytes_per_second = 0;
+    }
+
+    XeThru::DataRecorder recorder;
+    XeThru::DataTypes recording_types = 0;
+    std::atomic<bool> recording{false};
+
+    ofxXeThruRingBuffer<Record> queue;
+    ofxXeThruSignal queued;
+    // producer side encode buffer, writer side record being written
+    Record scratch;
+    Record writing;
+
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> failed{0};
+    std::atomic<size_t> max_queue_depth{0};
+    std::atomic<uint64_t> max_write_micros{0};
+    std::atomic<float> bytes_per_second{0};
+};
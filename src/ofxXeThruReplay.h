@@ -0,0 +1,114 @@
+//
+//  ofxXeThruReplay.h
+//  Unpaced batch replay of recordings for offline reprocessing. Records go
+//  straight from DataReader::read_record into a callback, with no playback
+//  timer, and a recording can be cut into time segments that are read on
+//  separate cores, each with its own DataReader.
+//
+
+#pragma once
+
+#include "DataReader.hpp"
+#include "ofxXeThruRecord.h"
+
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+class ofxXeThruReplay {
+
+public:
+
+    // segment is the index of the segment the record belongs to, 0 when run
+    // on the whole recording. Return false to stop reading that segment.
+    typedef std::function<bool(const ofxXeThruRecord & record, size_t segment)> Callback;
+
+    // whole recording on the calling thread, returns the number of records
+    // or -1 if the recording can't be opened
+    static int64_t run(const std::string & meta_filename, uint32_t data_types, const Callback & callback){
+        return runSegment(meta_filename, data_types, 0, -1, 0, callback);
+    }
+
+    // The recording is cut into segments spans of equal duration, read in
+    // parallel. The callback is called from several threads at once, keep
+    // state per segment. A record belongs to the segment its epoch falls in,
+    // so every record is delivered exactly once. Returns the total number of
+    // records, or -1 if the recording can't be opened.
+    static int64_t runParallel(const std::string & meta_filename, uint32_t data_types,
+                               size_t segments, const Callback & callback){
+        int64_t duration = 0;
+        {
+            XeThru::DataReader reader;
+            if (reader.open(meta_filename)) {
+                return -1;
+            }
+            duration = reader.get_duration();
+        }
+        if (segments == 0) {
+            segments = std::max(1u, std::thread::hardware_concurrency());
+        }
+
+        std::vector<int64_t> counts(segments, 0);
+        std::vector<std::thread> threads;
+        for (size_t s = 0; s < segments; ++s) {
+            const int64_t begin = duration * s / segments;
+            // the last segment is open ended so trailing records aren't lost
+            const int64_t end = s + 1 == segments ? -1 : duration * (s + 1) / segments;
+            threads.emplace_back([&, s, begin, end]{
+                counts[s] = runSegment(meta_filename, data_types, begin, end, s, callback);
+            });
+        }
+        int64_t total = 0;
+        for (size_t s = 0; s < segments; ++s) {
+            threads[s].join();
+            if (counts[s] < 0) {
+                return -1;
+            }
+            total += counts[s];
+        }
+        return total;
+    }
+
+    // records whose epoch lies in [begin, end) ms from the start of the
+    // recording, end < 0 reads to the end
+    static int64_t runSegment(const std::string & meta_filename, uint32_t data_types,
+                              int64_t begin, int64_t end, size_t segment, const Callback & callback){
+        XeThru::DataReader reader;
+        if (reader.open(meta_filename)) {
+            return -1;
+        }
+        reader.set_filter(data_types);
+        if (begin > 0 && reader.seek_ms(begin)) {
+            return -1;
+        }
+
+        // one buffer for the largest record, reused for all of them
+        std::vector<uint8_t> buffer(reader.get_max_record_size());
+        const int64_t start_epoch = reader.get_start_epoch();
+        ofxXeThruRecord record;
+        int64_t count = 0;
+        while (!reader.at_end()) {
+            uint8_t is_user_header = 0;
+            if (reader.read_record(buffer.data(), buffer.size(), &record.size,
+                                   &record.data_type, &record.epoch, &is_user_header)) {
+                break;
+            }
+            const int64_t position = record.epoch - start_epoch;
+            // seek_ms may land just before the segment start
+            if (position < begin) {
+                continue;
+            }
+            if (end >= 0 && position >= end) {
+                break;
+            }
+            record.data = buffer.data();
+            record.is_user_header = is_user_header != 0;
+            ++count;
+            if (!callback(record, segment)) {
+                break;
+            }
+        }
+        return count;
+    }
+};
@@ -0,0 +1,412 @@
+//
+//  ofxXeThruRespiration.h
+//  Host-side respiration and presence estimation on baseband frames, with
+//  the same RespirationData / PresenceSingleData output as the modules.
+//
+//    clutter removal   running mean background per bin, subtracted
+//    bin selection     bin with the most residual energy, over the median
+//                      energy of all bins (the noise floor)
+//    band-pass         biquad on the unwrapped phase of every bin, so the
+//                      selected bin's filter is already settled when the
+//                      selection moves
+//    rate estimation   spacing of upward zero crossings of the filtered
+//                      phase over a sliding window
+//
+//  ofxXeThruRespiration runs one stream on the calling thread.
+//  ofxXeThruRespirationBank runs many on an ofxXeThruThreadPool, frames of
+//  one sensor in order, different sensors on whichever cores are free.
+//
+
+#pragma once
+
+#include "Data.hpp"
+#include "xtid.h"
+
+#include "ofxXeThruRingBuffer.h"
+#include "ofxXeThruTripleBuffer.h"
+#include "ofxXeThruThreadPool.h"
+#include "ofxXeThruTrace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct ofxXeThruRespirationSettings {
+    float fps = 17;
+    float carrier_frequency = 7.29e9f;
+    // time constant of the clutter background
+    float background_seconds = 10;
+    // time constant of the per bin energy used for bin selection
+    float energy_seconds = 2;
+    // band-pass edges, respirations per minute
+    float min_rate = 6;
+    float max_rate = 40;
+    // zero crossings older than this don't count towards the rate
+    float rate_seconds = 20;
+    // selected bin energy over the noise floor that counts as presence
+    float presence_ratio = 4;
+};
+
+class ofxXeThruRespiration {
+
+public:
+
+    void setup(size_t _bins, float _range_offset, float _bin_length, const ofxXeThruRespirationSettings & _settings = ofxXeThruRespirationSettings()){
+        bins = _bins;
+        range_offset = _range_offset;
+        bin_length = _bin_length;
+        settings = _settings;
+
+        state.assign(bins, Bin());
+        energies.resize(bins);
+        background_alpha = 1.0f / std::max(1.0f, settings.background_seconds * settings.fps);
+        energy_alpha = 1.0f / std::max(1.0f, settings.energy_seconds * settings.fps);
+
+        // RBJ constant peak gain band-pass, centred on the geometric mean
+        const double low = settings.min_rate / 60.0;
+        const double high = settings.max_rate / 60.0;
+        const double centre = std::sqrt(low * high);
+        const double w0 = 2.0 * M_PI * centre / settings.fps;
+        const double alpha = std::sin(w0) * (high - low) / (2.0 * centre);
+        const double a0 = 1.0 + alpha;
+        b0 = alpha / a0;
+        a1 = -2.0 * std::cos(w0) / a0;
+        a2 = (1.0 - alpha) / a0;
+
+        // mm of chest movement per radian of phase, lambda / (4 pi)
+        mm_per_radian = 299792458.0f / settings.carrier_frequency * 1000.0f / (4.0f * float(M_PI));
+
+        frames = 0;
+        selected = 0;
+        crossing_count = 0;
+        respiration = XeThru::RespirationData();
+        respiration.sensor_state = XTS_VAL_RESP_STATE_INITIALIZING;
+        presence = XeThru::PresenceSingleData();
+        presence.presence_state = XTS_VAL_PRESENCE_PRESENCESTATE_INITIALIZING;
+    }
+
+    void update(const XeThru::BasebandIqData & iq){
+        if (iq.num_bins != bins || iq.range_offset != range_offset || iq.bin_length != bin_length) {
+            setup(iq.num_bins, iq.range_offset, iq.bin_length, settings);
+        }
+        update(iq.frame_counter, iq.i_data.data(), iq.q_data.data());
+    }
+
+    // one frame of bins I and Q samples, the outputs are refreshed every frame
+    void update(uint32_t frame_counter, const float * i, const float * q){
+        OFXXETHRU_TRACE_SCOPE("ofxXeThruRespiration::update");
+        if (bins == 0) {
+            // nothing to select a bin from
+            return;
+        }
+        ++frames;
+        for (size_t b = 0; b < bins; ++b) {
+            Bin & bin = state[b];
+            if (frames == 1) {
+                bin.background_i = i[b];
+                bin.background_q = q[b];
+                bin.wrapped = std::atan2(q[b], i[b]);
+                bin.phase = bin.wrapped;
+            }
+
+            // clutter removal
+            bin.background_i += background_alpha * (i[b] - bin.background_i);
+            bin.background_q += background_alpha * (q[b] - bin.background_q);
+            const float di = i[b] - bin.background_i;
+            const float dq = q[b] - bin.background_q;
+            bin.energy += energy_alpha * (di * di + dq * dq - bin.energy);
+            energies[b] = bin.energy;
+
+            // unwrapped phase, the target dominates the raw sample at its bin
+            const float phase = std::atan2(q[b], i[b]);
+            float step = phase - bin.wrapped;
+            step -= float(2 * M_PI) * std::floor((step + float(M_PI)) / float(2 * M_PI));
+            bin.wrapped = phase;
+            bin.phase += step;
+
+            // band-pass, transposed direct form II
+            bin.previous = bin.filtered;
+            const double x = bin.phase;
+            const double y = b0 * x + bin.z1;
+            bin.z1 = -a1 * y + bin.z2;
+            bin.z2 = -b0 * x - a2 * y;
+            bin.filtered = float(y);
+        }
+
+        // bin selection against the noise floor
+        size_t best = 0;
+        for (size_t b = 1; b < bins; ++b) {
+            if (state[b].energy > state[best].energy) {
+                best = b;
+            }
+        }
+        std::nth_element(energies.begin(), energies.begin() + bins / 2, energies.end());
+        const float floor = std::max(energies[bins / 2], 1e-30f);
+        const float ratio = state[best].energy / floor;
+        if (best != selected) {
+            selected = best;
+            crossing_count = 0;
+        }
+
+        // rate estimation from upward zero crossings of the selected bin
+        const Bin & bin = state[selected];
+        if (bin.previous < 0 && bin.filtered >= 0) {
+            crossings[crossing_count % max_crossings] = frames;
+            ++crossing_count;
+        }
+        float rate = 0;
+        const uint64_t oldest = frames > settings.rate_seconds * settings.fps ? frames - uint64_t(settings.rate_seconds * settings.fps) : 0;
+        size_t first = crossing_count > max_crossings ? crossing_count - max_crossings : 0;
+        while (first < crossing_count && crossings[first % max_crossings] < oldest) {
+            ++first;
+        }
+        if (crossing_count - first >= 3) {
+            const uint64_t span = crossings[(crossing_count - 1) % max_crossings] - crossings[first % max_crossings];
+            rate = 60.0f * settings.fps * (crossing_count - 1 - first) / span;
+        }
+
+        const bool initializing = frames < settings.background_seconds * settings.fps;
+        const bool present = ratio > settings.presence_ratio;
+        const bool breathing = present && rate >= settings.min_rate && rate <= settings.max_rate;
+        const float distance = range_offset + selected * bin_length;
+        // 0-10, 3 dB per step above the presence threshold
+        const float snr_db = 10.0f * std::log10(std::max(ratio / settings.presence_ratio, 1.0f));
+        const uint32_t quality = std::min(10u, uint32_t(snr_db / 3.0f));
+
+        respiration.frame_counter = frame_counter;
+        respiration.sensor_state = initializing ? XTS_VAL_RESP_STATE_INITIALIZING :
+            breathing ? XTS_VAL_RESP_STATE_BREATHING :
+            present ? XTS_VAL_RESP_STATE_MOVEMENT_TRACKING : XTS_VAL_RESP_STATE_NO_MOVEMENT;
+        respiration.respiration_rate = breathing ? uint32_t(rate + 0.5f) : 0;
+        respiration.distance = present ? distance : 0;
+        respiration.movement = present ? bin.filtered * mm_per_radian : 0;
+        respiration.signal_quality = present ? quality : 0;
+
+        presence.frame_counter = frame_counter;
+        presence.presence_state = initializing ? XTS_VAL_PRESENCE_PRESENCESTATE_INITIALIZING :
+            present ? XTS_VAL_PRESENCE_PRESENCESTATE_PRESENCE : XTS_VAL_PRESENCE_PRESENCESTATE_NO_PRESENCE;
+        presence.distance = present ? distance : 0;
+        presence.direction = 0;
+        presence.signal_quality = present ? quality : 0;
+    }
+
+    const XeThru::RespirationData & getRespiration() const {
+        return respiration;
+    }
+
+    const XeThru::PresenceSingleData & getPresence() const {
+        return presence;
+    }
+
+    size_t getSelectedBin() const {
+        return selected;
+    }
+
+    size_t getBins() const {
+        return bins;
+    }
+
+    const ofxXeThruRespirationSettings & getSettings() const {
+        return settings;
+    }
+
+private:
+
+    struct Bin {
+        float background_i = 0;
+        float background_q = 0;
+        float energy = 0;
+        float wrapped = 0;
+        // unwrapped phase grows without bound, keep it in double
+        double phase = 0;
+        double z1 = 0;
+        double z2 = 0;
+        float filtered = 0;
+        float previous = 0;
+    };
+
+    // enough for max_rate over rate_seconds at any sane setting
+    static const size_t max_crossings = 64;
+
+    size_t bins = 0;
+    float range_offset = 0;
+    float bin_length = 0;
+    ofxXeThruRespirationSettings settings;
+
+    std::vector<Bin> state;
+    std::vector<float> energies;
+    float background_alpha = 0;
+    float energy_alpha = 0;
+    double b0 = 0, a1 = 0, a2 = 0;
+    float mm_per_radian = 0;
+
+    uint64_t frames = 0;
+    size_t selected = 0;
+    uint64_t crossings[max_crossings] = {};
+    size_t crossing_count = 0;
+
+    XeThru::RespirationData respiration;
+    XeThru::PresenceSingleData presence;
+};
+
+
+//--------------------------------------------------------------
+class ofxXeThruRespirationBank {
+
+public:
+
+    // called on a pool thread after every frame of a sensor, never for
+    // two frames of the same sensor at once
+    typedef std::function<void(size_t sensor, const XeThru::RespirationData &, const XeThru::PresenceSingleData &)> Callback;
+
+    ~ofxXeThruRespirationBank(){
+        pool.stop();
+    }
+
+    // frames of up to max_bins bins, queue_size frames buffered per sensor
+    void setup(size_t sensors, size_t max_bins, const ofxXeThruRespirationSettings & settings = ofxXeThruRespirationSettings(),
+               size_t threads = 0, size_t queue_size = 64){
+        pool.stop();
+        strands.clear();
+        for (size_t s = 0; s < sensors; ++s) {
+            Strand * strand = new Strand();
+            strand->index = s;
+            strand->settings = settings;
+            auto reserve = [max_bins](Input & input){
+                input.iq.i_data.reserve(max_bins);
+                input.iq.q_data.reserve(max_bins);
+            };
+            strand->input.allocate(queue_size, reserve);
+            reserve(strand->current);
+            strand->output.allocate([](Output &){});
+            strands.emplace_back(strand);
+        }
+        pool.setup(threads);
+    }
+
+    void setCallback(Callback _callback){
+        callback = _callback;
+    }
+
+    // one producer thread per sensor. Returns false if the sensor's queue
+    // is full and the frame was dropped.
+    bool push(size_t sensor, const XeThru::BasebandIqData & iq){
+        Strand & strand = *strands[sensor];
+        strand.staging.iq = iq;
+        return enqueue(strand);
+    }
+
+    // a downconverted DataFloat, all I values then all Q values
+    bool push(size_t sensor, const XeThru::DataFloat & frame, float range_offset, float bin_length){
+        Strand & strand = *strands[sensor];
+        XeThru::BasebandIqData & iq = strand.staging.iq;
+        const size_t bins = frame.data.size() / 2;
+        iq.frame_counter = frame.info;
+        iq.num_bins = bins;
+        iq.range_offset = range_offset;
+        iq.bin_length = bin_length;
+        iq.i_data.assign(frame.data.begin(), frame.data.begin() + bins);
+        iq.q_data.assign(frame.data.begin() + bins, frame.data.begin() + bins * 2);
+        return enqueue(strand);
+    }
+
+    // newest outputs of a sensor, true if they changed since the last call.
+    // One reader thread.
+    bool getLatest(size_t sensor, XeThru::RespirationData & respiration, XeThru::PresenceSingleData & presence){
+        Strand & strand = *strands[sensor];
+        const bool changed = strand.output.hasNew();
+        const Output & output = strand.output.read();
+        respiration = output.respiration;
+        presence = output.presence;
+        return changed;
+    }
+
+    uint64_t getDroppedFrames(size_t sensor) const {
+        return strands[sensor]->dropped;
+    }
+
+    // blocks until every pushed frame is processed
+    void wait(){
+        pool.wait();
+    }
+
+    size_t size() const {
+        return strands.size();
+    }
+
+    size_t getNumThreads() const {
+        return pool.getNumThreads();
+    }
+
+private:
+
+    struct Input {
+        XeThru::BasebandIqData iq;
+    };
+
+    struct Output {
+        XeThru::RespirationData respiration;
+        XeThru::PresenceSingleData presence;
+    };
+
+    // one sensor: its frames are processed by at most one task at a time
+    struct Strand {
+        size_t index = 0;
+        ofxXeThruRespirationSettings settings;
+        ofxXeThruRespiration pipeline;
+        ofxXeThruRingBuffer<Input> input;
+        // producer side staging, consumer side frame being processed
+        Input staging;
+        Input current;
+        ofxXeThruTripleBuffer<Output> output;
+        std::atomic<bool> scheduled{false};
+        std::atomic<uint64_t> dropped{0};
+    };
+
+    // frames handled per task before yielding the worker to other sensors
+    static const size_t batch = 8;
+
+    bool enqueue(Strand & strand){
+        if (!strand.input.push(strand.staging)) {
+            ++strand.dropped;
+            return false;
+        }
+        schedule(strand);
+        return true;
+    }
+
+    void schedule(Strand & strand){
+        if (!strand.scheduled.exchange(true, std::memory_order_acq_rel)) {
+            pool.submit([this, &strand]{ drain(strand); });
+        }
+    }
+
+    void drain(Strand & strand){
+        for (size_t n = 0; n < batch && strand.input.pop(strand.current); ++n) {
+            const XeThru::BasebandIqData & iq = strand.current.iq;
+            if (strand.pipeline.getBins() == 0) {
+                strand.pipeline.setup(iq.num_bins, iq.range_offset, iq.bin_length, strand.settings);
+            }
+            strand.pipeline.update(iq);
+            Output & output = strand.output.getWriteBuffer();
+            output.respiration = strand.pipeline.getRespiration();
+            output.presence = strand.pipeline.getPresence();
+            strand.output.publish();
+            if (callback) {
+                callback(strand.index, output.respiration, output.presence);
+            }
+        }
+        strand.scheduled.store(false, std::memory_order_release);
+        // a frame pushed after the last pop but before the flag dropped
+        if (!strand.input.empty()) {
+            schedule(strand);
+        }
+    }
+
+    ofxXeThruThreadPool pool;
+    std::vector<std::unique_ptr<Strand>> strands;
+    Callback callback;
+};
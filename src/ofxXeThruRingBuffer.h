@@ -0,0 +1,81 @@
+//
+//  ofxXeThruRingBuffer.h
+//  Bounded single-producer/single-consumer queue used to hand radar
+//  frames from the acquisition thread to the openFrameworks thread.
+//
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+template<typename T>
+class ofxXeThruRingBuffer {
+
+public:
+
+    // capacity is rounded up to a power of two. All slots are created
+    // up front so push/pop never allocate once the slot payloads have
+    // grown to their steady state size.
+    void allocate(size_t capacity){
+        size_t n = 1;
+        while (n < capacity) n <<= 1;
+        slots.assign(n, T());
+        mask = n - 1;
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+
+    // same, with init called once on every slot (e.g. to reserve capacity)
+    template<typename F>
+    void allocate(size_t capacity, F init){
+        allocate(capacity);
+        for (size_t i = 0; i < slots.size(); ++i) {
+            init(slots[i]);
+        }
+    }
+
+    // producer side, returns false if the queue is full
+    bool push(const T & value){
+        const size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) > mask) {
+            return false;
+        }
+        slots[h & mask] = value;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side. The slot is swapped with value so both containers
+    // keep their capacity and nothing is copied.
+    bool pop(T & value){
+        const size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) {
+            return false;
+        }
+        std::swap(value, slots[t & mask]);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+    }
+
+    size_t capacity() const {
+        return slots.size();
+    }
+
+private:
+
+    std::vector<T> slots;
+    size_t mask = 0;
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,95 @@
+//
+//  ofxXeThruSignal.h
+//  Wakeup for a consumer of a lock-free queue. The producer calls notify()
+//  after pushing. The consumer either blocks in wait() on a condition
+//  variable, or puts getFileDescriptor() in its own poll/epoll/kqueue loop:
+//  the descriptor is the read end of a pipe that stays readable until the
+//  consumer has drained the queue and called reset().
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+class ofxXeThruSignal {
+
+public:
+
+    ofxXeThruSignal(){
+        if (pipe(fds) == 0) {
+            for (int fd : fds) {
+                fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                fcntl(fd, F_SETFD, FD_CLOEXEC);
+            }
+        } else {
+            fds[0] = fds[1] = -1;
+        }
+    }
+
+    ~ofxXeThruSignal(){
+        for (int fd : fds) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    ofxXeThruSignal(const ofxXeThruSignal &) = delete;
+    ofxXeThruSignal & operator=(const ofxXeThruSignal &) = delete;
+
+    // producer side, after the item is visible to the consumer. One byte
+    // goes into the pipe per empty to non-empty edge, not per item.
+    void notify(){
+        {
+            // pairs with the predicate check in wait() so no wakeup is lost
+            std::lock_guard<std::mutex> guard(mutex);
+        }
+        condition.notify_all();
+        if (!readable.exchange(true) && fds[1] >= 0) {
+            const char byte = 1;
+            ssize_t written = write(fds[1], &byte, 1);
+            (void)written;
+        }
+    }
+
+    // true once ready() holds, false on timeout
+    template<typename F>
+    bool wait(uint64_t timeout_ms, F ready){
+        std::unique_lock<std::mutex> guard(mutex);
+        return condition.wait_for(guard, std::chrono::milliseconds(timeout_ms), ready);
+    }
+
+    // consumer side, once the queue was found empty. The caller re-checks
+    // the queue afterwards and calls notify() again if something slipped
+    // in between, so the descriptor is never left unreadable with items in.
+    void reset(){
+        if (!readable.load()) {
+            return;
+        }
+        // drained before the flag drops, a notify() in between sees it
+        // still set and the caller's re-check picks its item up
+        if (fds[0] >= 0) {
+            char bytes[64];
+            while (read(fds[0], bytes, sizeof(bytes)) > 0) {}
+        }
+        readable.store(false);
+    }
+
+    // readable while there may be items, -1 if the pipe couldn't be made
+    int getFileDescriptor() const {
+        return fds[0];
+    }
+
+private:
+
+    int fds[2];
+    std::atomic<bool> readable{false};
+    std::mutex mutex;
+    std::condition_variable condition;
+};
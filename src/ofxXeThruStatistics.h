@@ -0,0 +1,237 @@
+//
+//  ofxXeThruStatistics.h
+//  Per bin running statistics of one sensor in constant memory: Welford
+//  mean and variance since reset, an exponential moving average and
+//  variance for the background, and min/max. Every update is one pass
+//  over the bins with the ofxXeThruSimd kernels, nothing is buffered.
+//  The Welford pair accumulates in double so months of frames at the
+//  module rate still move it.
+//
+//  The getters hand out plain float rows, so a snapshot is a copy, a row
+//  goes to ofxXeThruWaterfall::addRow() as is, and save()/load() let a
+//  restart pick up where the last run left off.
+//
+
+#pragma once
+
+#include "Data.hpp"
+
+#include "ofxXeThruDsp.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+class ofxXeThruStatistics {
+
+public:
+
+    // alpha is the EMA weight of each new frame, 1 / (seconds * fps) gives
+    // a time constant of that many seconds
+    void setup(size_t _bins, float _alpha = 0.01f){
+        bins = _bins;
+        alpha = _alpha;
+        mean.assign(bins, 0.0);
+        m2.assign(bins, 0.0);
+        for (std::vector<float> * row : rows()) {
+            row->assign(bins, 0.0f);
+        }
+        mean_row.assign(bins, 0.0f);
+        variance.assign(bins, 0.0f);
+        reset();
+    }
+
+    void reset(){
+        count = 0;
+        std::fill(mean.begin(), mean.end(), 0.0);
+        std::fill(m2.begin(), m2.end(), 0.0);
+        std::fill(ema.begin(), ema.end(), 0.0f);
+        std::fill(ema_variance.begin(), ema_variance.end(), 0.0f);
+        std::fill(minimum.begin(), minimum.end(), FLT_MAX);
+        std::fill(maximum.begin(), maximum.end(), -FLT_MAX);
+    }
+
+    // A frame of another size than bins is left out, false, as the
+    // Welford count is one for all bins. setup() again for a new size.
+    bool update(const float * values, size_t size){
+        if (size != bins || bins == 0) {
+            return false;
+        }
+        const size_t n = bins;
+        ++count;
+        if (count == 1) {
+            // the averages start at the first frame rather than at 0
+            std::copy(values, values + n, ema.begin());
+        }
+        const double inverse = 1.0 / double(count);
+        size_t b = 0;
+#if defined(OFXXETHRU_SIMD)
+        namespace simd = ofxXeThruSimd;
+        const simd::v2d w = simd::set1d(inverse);
+        const simd::v4 a = simd::set1(alpha);
+        const simd::v4 keep = simd::set1(1.0f - alpha);
+        for (; b + 4 <= n; b += 4) {
+            // Welford, two double lanes at a time
+            for (size_t h = b; h < b + 4; h += 2) {
+                const simd::v2d x = simd::widen(values + h);
+                simd::v2d m = simd::load(&mean[h]);
+                const simd::v2d delta = simd::sub(x, m);
+                m = simd::madd(delta, w, m);
+                simd::store(&mean[h], m);
+                simd::store(&m2[h], simd::madd(delta, simd::sub(x, m), simd::load(&m2[h])));
+            }
+            const simd::v4 x = simd::load(values + b);
+            // exponentially weighted mean and variance
+            const simd::v4 e = simd::load(&ema[b]);
+            const simd::v4 d = simd::sub(x, e);
+            simd::store(&ema[b], simd::madd(a, d, e));
+            simd::store(&ema_variance[b], simd::mul(keep, simd::madd(simd::mul(a, d), d, simd::load(&ema_variance[b]))));
+            simd::store(&minimum[b], simd::min(x, simd::load(&minimum[b])));
+            simd::store(&maximum[b], simd::max(x, simd::load(&maximum[b])));
+        }
+#endif
+        for (; b < n; ++b) {
+            const float x = values[b];
+            const double delta = x - mean[b];
+            mean[b] += delta * inverse;
+            m2[b] += delta * (x - mean[b]);
+            const float d = x - ema[b];
+            ema[b] += alpha * d;
+            ema_variance[b] = (1.0f - alpha) * (ema_variance[b] + alpha * d * d);
+            minimum[b] = std::min(x, minimum[b]);
+            maximum[b] = std::max(x, maximum[b]);
+        }
+        return true;
+    }
+
+    bool update(const XeThru::DataFloat & frame){
+        return update(frame.data.data(), frame.data.size());
+    }
+
+    bool update(const XeThru::BasebandApData & frame){
+        return update(frame.amplitude.data(), frame.amplitude.size());
+    }
+
+    size_t getNumBins() const {
+        return bins;
+    }
+
+    uint64_t getCount() const {
+        return count;
+    }
+
+    float getAlpha() const {
+        return alpha;
+    }
+
+    // mean since reset, rounded to float on call
+    const std::vector<float> & getMean(){
+        std::copy(mean.begin(), mean.end(), mean_row.begin());
+        return mean_row;
+    }
+
+    // sample variance since reset, worked out on call
+    const std::vector<float> & getVariance(){
+        const double scale = count > 1 ? 1.0 / double(count - 1) : 0.0;
+        for (size_t b = 0; b < bins; ++b) {
+            variance[b] = float(m2[b] * scale);
+        }
+        return variance;
+    }
+
+    const std::vector<float> & getEma() const {
+        return ema;
+    }
+
+    const std::vector<float> & getEmaVariance() const {
+        return ema_variance;
+    }
+
+    const std::vector<float> & getMin() const {
+        return minimum;
+    }
+
+    const std::vector<float> & getMax() const {
+        return maximum;
+    }
+
+    // Whole state in one file: "XTST", version, bins, alpha, count, the
+    // double mean and m2 rows, then the float rows. 0 on success.
+    int save(const std::string & filename) const {
+        FILE * file = std::fopen(filename.c_str(), "wb");
+        if (file == nullptr) {
+            return 1;
+        }
+        const uint32_t header[3] = {magic, version, uint32_t(bins)};
+        bool ok = std::fwrite(header, sizeof(header), 1, file) == 1 &&
+            std::fwrite(&alpha, sizeof(alpha), 1, file) == 1 &&
+            std::fwrite(&count, sizeof(count), 1, file) == 1 &&
+            std::fwrite(mean.data(), sizeof(double), bins, file) == bins &&
+            std::fwrite(m2.data(), sizeof(double), bins, file) == bins;
+        for (const std::vector<float> * row : rows()) {
+            ok = ok && std::fwrite(row->data(), sizeof(float), bins, file) == bins;
+        }
+        return (std::fclose(file) == 0 && ok) ? 0 : 1;
+    }
+
+    // replaces the current state, bins and alpha included
+    int load(const std::string & filename){
+        FILE * file = std::fopen(filename.c_str(), "rb");
+        if (file == nullptr) {
+            return 1;
+        }
+        uint32_t header[3];
+        float stored_alpha = 0;
+        uint64_t stored_count = 0;
+        if (std::fread(header, sizeof(header), 1, file) != 1 || header[0] != magic || header[1] != version ||
+            std::fread(&stored_alpha, sizeof(stored_alpha), 1, file) != 1 ||
+            std::fread(&stored_count, sizeof(stored_count), 1, file) != 1) {
+            std::fclose(file);
+            return 1;
+        }
+        setup(header[2], stored_alpha);
+        bool ok = std::fread(mean.data(), sizeof(double), bins, file) == bins &&
+            std::fread(m2.data(), sizeof(double), bins, file) == bins;
+        for (std::vector<float> * row : rows()) {
+            ok = ok && std::fread(row->data(), sizeof(float), bins, file) == bins;
+        }
+        std::fclose(file);
+        if (!ok) {
+            setup(bins, alpha);
+            return 1;
+        }
+        count = stored_count;
+        return 0;
+    }
+
+private:
+
+    static const uint32_t magic = 0x54535458; // "XTST"
+    static const uint32_t version = 2;
+
+    // the float rows
+    std::vector<std::vector<float> *> rows(){
+        return {&ema, &ema_variance, &minimum, &maximum};
+    }
+
+    std::vector<const std::vector<float> *> rows() const {
+        return {&ema, &ema_variance, &minimum, &maximum};
+    }
+
+    size_t bins = 0;
+    float alpha = 0.01f;
+    uint64_t count = 0;
+
+    std::vector<double> mean;
+    std::vector<double> m2;
+    std::vector<float> ema;
+    std::vector<float> ema_variance;
+    std::vector<float> minimum;
+    std::vector<float> maximum;
+    // getMean() and getVariance() scratch
+    std::vector<float> mean_row;
+    std::vector<float> variance;
+};
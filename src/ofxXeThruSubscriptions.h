@@ -0,0 +1,194 @@
+//
+//  ofxXeThruSubscriptions.h
+//  Push delivery of X4M200/X4M300 messages. Each subscribed message type
+//  gets a thread that sits in the blocking read_message_*() call and hands
+//  the decoded message to its callback the moment it arrives, so there is
+//  no peek_message_*() polling and no queue of our own. Every reader
+//  decodes into the same message object each time, so vectors keep their
+//  capacity.
+//
+//  read_message_*() blocks for at most the connector's default timeout
+//  (ModuleConnector::set_default_timeout), which bounds how long stop()
+//  takes. Callbacks run on the reader threads, one thread per type, so a
+//  slow callback only delays its own stream.
+//
+//  Given to ofxXeThru::setSubscriptions() the readers follow the sensor's
+//  own connector, through reconnects. Started by hand on a connector they
+//  last as long as that connector's link does.
+//
+
+#pragma once
+
+#include "ModuleConnector.hpp"
+#include "X4M200.hpp"
+#include "X4M300.hpp"
+#include "Data.hpp"
+
+#include "ofxXeThruTrace.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class ofxXeThruSubscriptions {
+
+public:
+
+    ~ofxXeThruSubscriptions(){
+        stop();
+    }
+
+    // register before start(), a type without a callback isn't read
+    void onBasebandAp(std::function<void(const XeThru::BasebandApData &)> callback){
+        add<XeThru::X4M200, XeThru::BasebandApData>(&XeThru::X4M200::read_message_baseband_ap, "X4M200::read_message_baseband_ap", callback);
+    }
+
+    void onBasebandIq(std::function<void(const XeThru::BasebandIqData &)> callback){
+        add<XeThru::X4M200, XeThru::BasebandIqData>(&XeThru::X4M200::read_message_baseband_iq, "X4M200::read_message_baseband_iq", callback);
+    }
+
+    void onRespirationLegacy(std::function<void(const XeThru::RespirationData &)> callback){
+        add<XeThru::X4M200, XeThru::RespirationData>(&XeThru::X4M200::read_message_respiration_legacy, "X4M200::read_message_respiration_legacy", callback);
+    }
+
+    void onRespirationSleep(std::function<void(const XeThru::SleepData &)> callback){
+        add<XeThru::X4M200, XeThru::SleepData>(&XeThru::X4M200::read_message_respiration_sleep, "X4M200::read_message_respiration_sleep", callback);
+    }
+
+    void onRespirationMovingList(std::function<void(const XeThru::RespirationMovingListData &)> callback){
+        add<XeThru::X4M200, XeThru::RespirationMovingListData>(&XeThru::X4M200::read_message_respiration_movinglist, "X4M200::read_message_respiration_movinglist", callback);
+    }
+
+    void onRespirationDetectionList(std::function<void(const XeThru::RespirationDetectionListData &)> callback){
+        add<XeThru::X4M200, XeThru::RespirationDetectionListData>(&XeThru::X4M200::read_message_respiration_detectionlist, "X4M200::read_message_respiration_detectionlist", callback);
+    }
+
+    void onPulseDopplerFloat(std::function<void(const XeThru::PulseDopplerFloatData &)> callback){
+        add<XeThru::X4M200, XeThru::PulseDopplerFloatData>(&XeThru::X4M200::read_message_pulsedoppler_float, "X4M200::read_message_pulsedoppler_float", callback);
+    }
+
+    void onPulseDopplerByte(std::function<void(const XeThru::PulseDopplerByteData &)> callback){
+        add<XeThru::X4M200, XeThru::PulseDopplerByteData>(&XeThru::X4M200::read_message_pulsedoppler_byte, "X4M200::read_message_pulsedoppler_byte", callback);
+    }
+
+    void onNoisemapFloat(std::function<void(const XeThru::PulseDopplerFloatData &)> callback){
+        add<XeThru::X4M200, XeThru::PulseDopplerFloatData>(&XeThru::X4M200::read_message_noisemap_float, "X4M200::read_message_noisemap_float", callback);
+    }
+
+    void onNoisemapByte(std::function<void(const XeThru::PulseDopplerByteData &)> callback){
+        add<XeThru::X4M200, XeThru::PulseDopplerByteData>(&XeThru::X4M200::read_message_noisemap_byte, "X4M200::read_message_noisemap_byte", callback);
+    }
+
+    // X4M300 presence profile
+    void onPresenceSingle(std::function<void(const XeThru::PresenceSingleData &)> callback){
+        add<XeThru::X4M300, XeThru::PresenceSingleData>(&XeThru::X4M300::read_message_presence_single, "X4M300::read_message_presence_single", callback);
+    }
+
+    void onPresenceMovingList(std::function<void(const XeThru::PresenceMovingListData &)> callback){
+        add<XeThru::X4M300, XeThru::PresenceMovingListData>(&XeThru::X4M300::read_message_presence_movinglist, "X4M300::read_message_presence_movinglist", callback);
+    }
+
+    bool empty() const {
+        return readers.empty();
+    }
+
+    // mc has to outlive stop(), and stop() has to come before mc is
+    // closed or reopened
+    void start(XeThru::ModuleConnector & mc){
+        stop();
+        running = true;
+        for (size_t r = 0; r < readers.size(); ++r) {
+            Reader * reader = readers[r].get();
+            // on this thread, the connector creates the interface once
+            reader->bind(mc);
+            threads.emplace_back([this, reader]{
+                OFXXETHRU_TRACE_THREAD("ofxXeThruSubscriptions reader");
+                while (running) {
+                    reader->read();
+                }
+            });
+        }
+    }
+
+    // returns once every reader is out of its read call
+    void stop(){
+        running = false;
+        for (size_t t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+        threads.clear();
+    }
+
+    bool isRunning() const {
+        return running;
+    }
+
+    void clear(){
+        stop();
+        readers.clear();
+    }
+
+private:
+
+    struct Reader {
+        virtual ~Reader(){}
+        virtual void bind(XeThru::ModuleConnector & mc) = 0;
+        virtual void read() = 0;
+    };
+
+    // the interface of mc a Module's read_message_*() is called on
+    static XeThru::X4M200 & getModule(XeThru::ModuleConnector & mc, const XeThru::X4M200 *){
+        return mc.get_x4m200();
+    }
+
+    static XeThru::X4M300 & getModule(XeThru::ModuleConnector & mc, const XeThru::X4M300 *){
+        return mc.get_x4m300();
+    }
+
+    template<typename Module, typename T>
+    struct TypedReader : public Reader {
+        typedef int (Module::*Read)(T *);
+
+        TypedReader(Read _function, const char * _name, std::function<void(const T &)> _callback) :
+            function(_function), name(_name), callback(_callback) {}
+
+        void bind(XeThru::ModuleConnector & mc){
+            module = &getModule(mc, static_cast<const Module *>(nullptr));
+        }
+
+        void read(){
+            int status;
+            {
+                OFXXETHRU_TRACE_SCOPE(name);
+                status = (module->*function)(&message);
+            }
+            // a timeout comes back as an error, go around and check running
+            if (status == 0) {
+                OFXXETHRU_TRACE_SCOPE("ofxXeThruSubscriptions callback");
+                callback(message);
+            } else {
+                // other errors come back right away, don't spin on them
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        Module * module = nullptr;
+        Read function;
+        // trace name, a literal
+        const char * name;
+        std::function<void(const T &)> callback;
+        T message;
+    };
+
+    template<typename Module, typename T>
+    void add(typename TypedReader<Module, T>::Read function, const char * name, std::function<void(const T &)> callback){
+        readers.emplace_back(new TypedReader<Module, T>(function, name, callback));
+    }
+
+    std::vector<std::unique_ptr<Reader>> readers;
+    std::vector<std::thread> threads;
+    std::atomic<bool> running{false};
+};
@@ -0,0 +1,285 @@
+//
+//  ofxXeThruSync.h
+//  Puts frames of several modules on the host clock and assembles them
+//  into super-frames, one per tick.
+//
+//  Every module gets a clock model fitted to its frame counter against the
+//  host receive time: the period (and so its drift against the host) from
+//  a least squares line, the offset from the lower envelope of the receive
+//  times, since queuing only ever makes a frame late. The one-way link
+//  latency, from ping() round trips, is taken off so modules on slower
+//  links line up with the rest.
+//
+//  Frames wait in a small fixed jitter buffer per module. Each tick picks
+//  the frame of every module closest to the tick time and copies it into
+//  one contiguous sensors x bins block.
+//
+
+#pragma once
+
+#include "ofxXeThruFrame.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+struct ofxXeThruSuperFrame {
+    // host time of the tick, ofGetElapsedTimeMicros() clock
+    uint64_t time = 0;
+    uint64_t tick = 0;
+    size_t sensors = 0;
+    size_t bins = 0;
+    // sensors x bins, zeros for a module with no frame at this tick
+    std::vector<float> data;
+    std::vector<uint8_t> valid;
+    std::vector<uint32_t> frame_counters;
+    // estimated frame time minus tick time, microseconds
+    std::vector<int32_t> skew;
+
+    const float * getRow(size_t sensor) const {
+        return &data[sensor * bins];
+    }
+};
+
+class ofxXeThruSync {
+
+public:
+
+    // depth: frames buffered per module, the super-frame for a tick is made
+    // depth / 2 frame periods after the tick so late frames still make it
+    void setup(size_t _sensors, size_t _bins, float _fps, size_t _depth = 4){
+        sensors = _sensors;
+        bins = _bins;
+        depth = std::max<size_t>(_depth, 2);
+        nominal_period = 1e6 / _fps;
+
+        clocks.assign(sensors, Clock());
+        for (Clock & clock : clocks) {
+            clock.nominal = nominal_period;
+        }
+        buffers.assign(sensors, std::vector<Slot>(depth));
+        for (std::vector<Slot> & buffer : buffers) {
+            for (Slot & slot : buffer) {
+                slot.data.assign(bins, 0.0f);
+            }
+        }
+        next_tick = 0;
+        ticks = 0;
+        started = false;
+        skipped = 0;
+    }
+
+    // half the ping round trip in microseconds, from ofxXeThru
+    void setLinkLatency(size_t sensor, double micros){
+        clocks[sensor].link_latency = micros;
+    }
+
+    // the frame's receive timestamp and counter feed its module's clock
+    void addFrame(const ofxXeThruFrame & frame){
+        const size_t sensor = frame.device_id;
+        if (sensor >= sensors) {
+            return;
+        }
+        Clock & clock = clocks[sensor];
+        clock.add(frame.info, frame.timestamp);
+        const double time = clock.estimate(frame.info);
+
+        // the oldest slot makes room
+        std::vector<Slot> & buffer = buffers[sensor];
+        Slot * slot = &buffer[0];
+        for (Slot & candidate : buffer) {
+            if (!candidate.filled || candidate.time < slot->time) {
+                slot = &candidate;
+                if (!candidate.filled) {
+                    break;
+                }
+            }
+        }
+        slot->filled = true;
+        slot->time = time;
+        slot->frame_counter = frame.info;
+        const size_t count = std::min(bins, frame.data.size());
+        std::copy(frame.data.begin(), frame.data.begin() + count, slot->data.begin());
+        std::fill(slot->data.begin() + count, slot->data.end(), 0.0f);
+
+        if (!started) {
+            started = true;
+            next_tick = time;
+        }
+    }
+
+    // Next super-frame whose tick is old enough, now on the host clock.
+    // Ticks that fell behind by more than the buffer holds are skipped.
+    bool getNextSuperFrame(uint64_t now, ofxXeThruSuperFrame & frame){
+        const double delay = nominal_period * depth / 2;
+        if (!started || now < next_tick + delay) {
+            return false;
+        }
+        while (now > next_tick + delay + nominal_period * depth) {
+            next_tick += nominal_period;
+            ++ticks;
+            ++skipped;
+        }
+
+        allocate(frame);
+        frame.time = uint64_t(next_tick);
+        frame.tick = ticks;
+        for (size_t s = 0; s < sensors; ++s) {
+            Slot * best = nullptr;
+            for (Slot & slot : buffers[s]) {
+                if (slot.filled && (best == nullptr || std::fabs(slot.time - next_tick) < std::fabs(best->time - next_tick))) {
+                    best = &slot;
+                }
+            }
+            float * row = &frame.data[s * bins];
+            if (best != nullptr && std::fabs(best->time - next_tick) <= nominal_period / 2) {
+                std::copy(best->data.begin(), best->data.end(), row);
+                frame.valid[s] = 1;
+                frame.frame_counters[s] = best->frame_counter;
+                frame.skew[s] = int32_t(best->time - next_tick);
+                // used once
+                best->filled = false;
+            } else {
+                std::fill(row, row + bins, 0.0f);
+                frame.valid[s] = 0;
+                frame.frame_counters[s] = 0;
+                frame.skew[s] = 0;
+                ++clocks[s].missed;
+            }
+        }
+        next_tick += nominal_period;
+        ++ticks;
+        return true;
+    }
+
+    // host microseconds at frame counter 0, link latency taken off
+    double getOffset(size_t sensor) const {
+        return clocks[sensor].offset - clocks[sensor].link_latency;
+    }
+
+    // module frame period on the host clock, microseconds
+    double getPeriod(size_t sensor) const {
+        return clocks[sensor].period > 0 ? clocks[sensor].period : nominal_period;
+    }
+
+    // module clock against the host clock, parts per million
+    double getDrift(size_t sensor) const {
+        return clocks[sensor].period > 0 ? (clocks[sensor].period / nominal_period - 1.0) * 1e6 : 0;
+    }
+
+    // ticks this module had no frame for
+    uint64_t getMissedTicks(size_t sensor) const {
+        return clocks[sensor].missed;
+    }
+
+    uint64_t getSkippedTicks() const {
+        return skipped;
+    }
+
+    size_t getNumSensors() const {
+        return sensors;
+    }
+
+private:
+
+    // receive times are fitted over this many frames, about a minute at
+    // 17 fps, so a few ms of jitter is around ten ppm of drift
+    static const size_t window = 1024;
+
+    struct Clock {
+        uint32_t counters[window];
+        uint64_t times[window];
+        size_t count = 0;
+        size_t head = 0;
+        // until enough frames are in to fit
+        double nominal = 0;
+        double period = 0;
+        double offset = 0;
+        double link_latency = 0;
+        uint64_t missed = 0;
+
+        void add(uint32_t counter, uint64_t time){
+            // a counter that goes back or leaps is a restart, fit again
+            if (count > 0) {
+                const uint32_t last = counters[(head + window - 1) % window];
+                const uint32_t step = counter - last;
+                if (step == 0 || step > 0x10000u) {
+                    count = 0;
+                    head = 0;
+                    period = 0;
+                }
+            }
+            counters[head] = counter;
+            times[head] = time;
+            head = (head + 1) % window;
+            count = std::min(count + 1, window);
+            fit();
+        }
+
+        // least squares slope around the first sample so the sums stay
+        // small, then the offset of the earliest arrival
+        void fit(){
+            const size_t first = (head + window - count) % window;
+            const uint32_t c0 = counters[first];
+            const uint64_t t0 = times[first];
+            if (count >= 8) {
+                double sc = 0, st = 0, scc = 0, sct = 0;
+                for (size_t n = 0; n < count; ++n) {
+                    const size_t k = (first + n) % window;
+                    const double c = double(uint32_t(counters[k] - c0));
+                    const double t = double(int64_t(times[k] - t0));
+                    sc += c; st += t; scc += c * c; sct += c * t;
+                }
+                const double denominator = count * scc - sc * sc;
+                if (denominator > 0) {
+                    period = (count * sct - sc * st) / denominator;
+                }
+            }
+            double envelope = 1e300;
+            for (size_t n = 0; n < count; ++n) {
+                const size_t k = (first + n) % window;
+                const double c = double(uint32_t(counters[k] - c0));
+                envelope = std::min(envelope, double(int64_t(times[k] - t0)) - c * usedPeriod());
+            }
+            offset = double(t0) + envelope - double(c0) * usedPeriod();
+        }
+
+        double usedPeriod() const {
+            return period > 0 ? period : nominal;
+        }
+
+        double estimate(uint32_t counter) const {
+            return offset + double(counter) * usedPeriod() - link_latency;
+        }
+    };
+
+    struct Slot {
+        bool filled = false;
+        double time = 0;
+        uint32_t frame_counter = 0;
+        std::vector<float> data;
+    };
+
+    void allocate(ofxXeThruSuperFrame & frame) const {
+        frame.sensors = sensors;
+        frame.bins = bins;
+        frame.data.resize(sensors * bins);
+        frame.valid.resize(sensors);
+        frame.frame_counters.resize(sensors);
+        frame.skew.resize(sensors);
+    }
+
+    size_t sensors = 0;
+    size_t bins = 0;
+    size_t depth = 4;
+    double nominal_period = 0;
+
+    std::vector<Clock> clocks;
+    std::vector<std::vector<Slot>> buffers;
+
+    bool started = false;
+    double next_tick = 0;
+    uint64_t ticks = 0;
+    uint64_t skipped = 0;
+};
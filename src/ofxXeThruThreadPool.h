@@ -0,0 +1,169 @@
+//
+//  ofxXeThruThreadPool.h
+//  Work-stealing thread pool. Every worker has its own task deque: tasks
+//  submitted from a worker go to the back of its own deque and are taken
+//  from the back again, so related work stays on one core, and an idle
+//  worker steals from the front of the others. Tasks submitted from
+//  outside the pool are spread round robin.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ofxXeThruThreadPool {
+
+public:
+
+    typedef std::function<void()> Task;
+
+    ~ofxXeThruThreadPool(){
+        stop();
+    }
+
+    // 0 uses one thread per core
+    void setup(size_t threads = 0){
+        stop();
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        running = true;
+        for (size_t w = 0; w < threads; ++w) {
+            workers.emplace_back(new Worker());
+        }
+        for (size_t w = 0; w < threads; ++w) {
+            workers[w]->thread = std::thread([this, w]{ work(w); });
+        }
+    }
+
+    // runs on any worker, in no particular order
+    void submit(Task task){
+        if (workers.empty()) {
+            // before setup() or after stop(), run it here rather than lose it
+            task();
+            return;
+        }
+        const size_t self = current().pool == this ? current().index : next++ % workers.size();
+        Worker & worker = *workers[self];
+        ++pending;
+        // counted first so it never drops below the number of queued tasks
+        ++queued;
+        {
+            std::lock_guard<std::mutex> guard(worker.mutex);
+            worker.tasks.push_back(std::move(task));
+        }
+        {
+            // pairs with the predicate check of a worker going to sleep
+            std::lock_guard<std::mutex> guard(idle_mutex);
+        }
+        idle.notify_one();
+    }
+
+    // blocks until every submitted task has run, tasks they submit included
+    void wait(){
+        std::unique_lock<std::mutex> guard(idle_mutex);
+        done.wait(guard, [this]{ return pending == 0; });
+    }
+
+    // queued tasks that haven't started are dropped
+    void stop(){
+        {
+            std::lock_guard<std::mutex> guard(idle_mutex);
+            running = false;
+        }
+        idle.notify_all();
+        for (std::unique_ptr<Worker> & worker : workers) {
+            worker->thread.join();
+        }
+        workers.clear();
+        pending = 0;
+        queued = 0;
+        done.notify_all();
+    }
+
+    size_t getNumThreads() const {
+        return workers.size();
+    }
+
+private:
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    struct Current {
+        const ofxXeThruThreadPool * pool = nullptr;
+        size_t index = 0;
+    };
+
+    static Current & current(){
+        static thread_local Current instance;
+        return instance;
+    }
+
+    // own deque from the back, then the others from the front
+    bool take(size_t self, Task & task){
+        {
+            Worker & worker = *workers[self];
+            std::lock_guard<std::mutex> guard(worker.mutex);
+            if (!worker.tasks.empty()) {
+                task = std::move(worker.tasks.back());
+                worker.tasks.pop_back();
+                return true;
+            }
+        }
+        for (size_t n = 1; n < workers.size(); ++n) {
+            Worker & victim = *workers[(self + n) % workers.size()];
+            std::lock_guard<std::mutex> guard(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(size_t self){
+        current().pool = this;
+        current().index = self;
+        Task task;
+        while (true) {
+            if (take(self, task)) {
+                --queued;
+                task();
+                task = nullptr;
+                if (--pending == 0) {
+                    std::lock_guard<std::mutex> guard(idle_mutex);
+                    done.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(idle_mutex);
+            idle.wait(guard, [this]{ return queued > 0 || !running; });
+            if (!running) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> running{false};
+    std::atomic<size_t> next{0};
+    // submitted and not finished, and waiting in a deque
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> queued{0};
+    std::mutex idle_mutex;
+    std::condition_variable idle;
+    std::condition_variable done;
+};
@@ -0,0 +1,264 @@
+//
+//  ofxXeThruTrace.h
+//  Trace points for the frame path. Build with OFXXETHRU_TRACE defined to
+//  turn them on; without it the macros expand to nothing and cost nothing.
+//
+//    OFXXETHRU_TRACE_SCOPE("read");          // from here to end of scope
+//    OFXXETHRU_TRACE_THREAD("acquisition");  // names the calling thread
+//
+//  Every thread writes fixed size events into its own ring, so recording
+//  is a clock read and a few stores, no lock, no allocation and no string
+//  formatting. Names must be string literals, only the pointer is kept.
+//  The rings can be exported as Chrome trace JSON (chrome://tracing or
+//  ui.perfetto.dev) or summarised as per stage percentiles.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef OFXXETHRU_TRACE
+#define OFXXETHRU_TRACE_CONCAT_(a, b) a##b
+#define OFXXETHRU_TRACE_CONCAT(a, b) OFXXETHRU_TRACE_CONCAT_(a, b)
+#define OFXXETHRU_TRACE_SCOPE(name) ofxXeThruTrace::Scope OFXXETHRU_TRACE_CONCAT(ofxxethru_trace_, __LINE__)(name)
+#define OFXXETHRU_TRACE_SPAN(name, begin_ns, end_ns) ofxXeThruTrace::record(name, begin_ns, end_ns)
+#define OFXXETHRU_TRACE_THREAD(name) ofxXeThruTrace::setThreadName(name)
+#else
+#define OFXXETHRU_TRACE_SCOPE(name)
+#define OFXXETHRU_TRACE_SPAN(name, begin_ns, end_ns)
+#define OFXXETHRU_TRACE_THREAD(name)
+#endif
+
+class ofxXeThruTrace {
+
+public:
+
+    // events kept per thread, older ones are overwritten
+    static const size_t ring_size = 1 << 14;
+
+    struct Event {
+        const char * name;
+        uint64_t begin;
+        uint64_t end;
+        uint32_t thread;
+    };
+
+    struct Stage {
+        std::string name;
+        size_t count = 0;
+        // microseconds
+        double p50 = 0;
+        double p99 = 0;
+        double max = 0;
+    };
+
+    static uint64_t now(){
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void record(const char * name, uint64_t begin, uint64_t end){
+        Ring & ring = local();
+        const uint64_t h = ring.head.load(std::memory_order_relaxed);
+        const uint64_t generation = registry().generation.load(std::memory_order_relaxed);
+        if (ring.generation.load(std::memory_order_relaxed) != generation) {
+            // clear() happened, applied here by the only writer of this ring
+            ring.first.store(h, std::memory_order_relaxed);
+            ring.generation.store(generation, std::memory_order_release);
+        }
+        Slot & slot = ring.slots[h & (ring_size - 1)];
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.begin.store(begin, std::memory_order_relaxed);
+        slot.end.store(end, std::memory_order_relaxed);
+        ring.head.store(h + 1, std::memory_order_release);
+    }
+
+    static void setThreadName(const char * name){
+        local().name.store(name, std::memory_order_relaxed);
+    }
+
+    class Scope {
+    public:
+        Scope(const char * _name) : name(_name), begin(now()) {}
+        ~Scope(){ record(name, begin, now()); }
+    private:
+        const char * name;
+        uint64_t begin;
+    };
+
+    // Copy of every ring, oldest first per thread. Safe while tracing, an
+    // event overwritten during the copy is left out rather than torn.
+    static std::vector<Event> snapshot(){
+        std::vector<Event> events;
+        std::lock_guard<std::mutex> guard(registry().mutex);
+        const uint64_t generation = registry().generation.load(std::memory_order_relaxed);
+        for (const std::shared_ptr<Ring> & ring : registry().rings) {
+            if (ring->generation.load(std::memory_order_acquire) != generation) {
+                // nothing recorded since the last clear()
+                continue;
+            }
+            const uint64_t head = ring->head.load(std::memory_order_acquire);
+            const uint64_t first = std::max(ring->first.load(std::memory_order_relaxed), head > ring_size ? head - ring_size : 0);
+            const size_t start = events.size();
+            for (uint64_t n = first; n < head; ++n) {
+                const Slot & slot = ring->slots[n & (ring_size - 1)];
+                Event event;
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.begin = slot.begin.load(std::memory_order_relaxed);
+                event.end = slot.end.load(std::memory_order_relaxed);
+                event.thread = ring->id;
+                events.push_back(event);
+            }
+            // whatever the writer lapped while we were copying, plus the
+            // slot it may be in the middle of: events before bound
+            const uint64_t after = ring->head.load(std::memory_order_acquire);
+            const uint64_t bound = after + 1 > ring_size ? after + 1 - ring_size : 0;
+            const uint64_t overwritten = bound > first ? std::min(bound, head) - first : 0;
+            events.erase(events.begin() + start, events.begin() + start + overwritten);
+        }
+        return events;
+    }
+
+    // per name, sorted by name
+    static std::vector<Stage> getSummary(){
+        std::vector<Event> events = snapshot();
+        std::sort(events.begin(), events.end(), [](const Event & a, const Event & b){
+            const int order = std::strcmp(a.name, b.name);
+            return order < 0 || (order == 0 && a.end - a.begin < b.end - b.begin);
+        });
+        std::vector<Stage> stages;
+        for (size_t first = 0; first < events.size();) {
+            size_t last = first;
+            while (last < events.size() && std::strcmp(events[last].name, events[first].name) == 0) {
+                ++last;
+            }
+            const size_t count = last - first;
+            auto at = [&](double p){
+                const Event & event = events[first + std::min(count - 1, size_t(p * count))];
+                return (event.end - event.begin) / 1000.0;
+            };
+            Stage stage;
+            stage.name = events[first].name;
+            stage.count = count;
+            stage.p50 = at(0.5);
+            stage.p99 = at(0.99);
+            stage.max = at(1.0);
+            stages.push_back(stage);
+            first = last;
+        }
+        return stages;
+    }
+
+    // Chrome trace event format, complete ("X") events in microseconds
+    static bool writeChromeTrace(const std::string & filename){
+        FILE * file = std::fopen(filename.c_str(), "w");
+        if (file == nullptr) {
+            return false;
+        }
+        std::fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        {
+            std::lock_guard<std::mutex> guard(registry().mutex);
+            for (const std::shared_ptr<Ring> & ring : registry().rings) {
+                const char * name = ring->name.load(std::memory_order_relaxed);
+                if (name != nullptr) {
+                    std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                                 first ? "" : ",\n", ring->id, name);
+                    first = false;
+                }
+            }
+        }
+        for (const Event & event : snapshot()) {
+            std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                         first ? "" : ",\n", event.name, event.thread,
+                         event.begin / 1000.0, (event.end - event.begin) / 1000.0);
+            first = false;
+        }
+        std::fprintf(file, "\n]}\n");
+        // finished threads are in the file now, their rings can go
+        dropExited();
+        return std::fclose(file) == 0;
+    }
+
+    // Drops every recorded event. Writers are never touched from here:
+    // each one starts its ring over at its next event, and until then
+    // the ring is left out of snapshots. Rings of finished threads go.
+    static void clear(){
+        registry().generation.fetch_add(1, std::memory_order_relaxed);
+        dropExited();
+    }
+
+private:
+
+    struct Slot {
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> begin{0};
+        std::atomic<uint64_t> end{0};
+    };
+
+    struct Ring {
+        uint32_t id = 0;
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> head{0};
+        // first event since the clear() generation the writer last saw
+        std::atomic<uint64_t> first{0};
+        std::atomic<uint64_t> generation{0};
+        // the owning thread is gone, no more writes
+        std::atomic<bool> exited{false};
+        Slot slots[ring_size];
+    };
+
+    struct Registry {
+        std::mutex mutex;
+        // shared so a thread's events outlive the thread
+        std::vector<std::shared_ptr<Ring>> rings;
+        std::atomic<uint64_t> generation{0};
+        uint32_t next_id = 0;
+    };
+
+    // marks the ring when its thread exits
+    struct Owner {
+        std::shared_ptr<Ring> ring;
+        ~Owner(){
+            if (ring) {
+                ring->exited.store(true, std::memory_order_release);
+            }
+        }
+    };
+
+    static void dropExited(){
+        std::lock_guard<std::mutex> guard(registry().mutex);
+        std::vector<std::shared_ptr<Ring>> & rings = registry().rings;
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::shared_ptr<Ring> & ring){
+            return ring->exited.load(std::memory_order_acquire);
+        }), rings.end());
+    }
+
+    static Registry & registry(){
+        static Registry instance;
+        return instance;
+    }
+
+    // created on a thread's first event, the only time a lock is taken
+    static Ring & local(){
+        static thread_local Owner owner;
+        if (!owner.ring) {
+            std::shared_ptr<Ring> ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> guard(registry().mutex);
+            ring->id = registry().next_id++;
+            ring->generation.store(registry().generation.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            registry().rings.push_back(ring);
+            owner.ring = ring;
+        }
+        return *owner.ring;
+    }
+};
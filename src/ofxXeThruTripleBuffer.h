@@ -0,0 +1,61 @@
+//
+//  ofxXeThruTripleBuffer.h
+//  Lock-free "latest value" handoff between one writer and one reader.
+//
+//  The writer fills the back slot and publishes it by swapping it with the
+//  spare slot. The reader swaps the spare slot with its front slot when a new
+//  value is pending. Neither side waits on the other and, once the slots have
+//  grown to the frame size, nothing is allocated.
+//
+
+#pragma once
+
+#include <atomic>
+
+template<typename T>
+class ofxXeThruTripleBuffer {
+
+public:
+
+    // calls init once on every slot, before the writer starts
+    template<typename F>
+    void allocate(F init){
+        for (int i = 0; i < 3; ++i) {
+            init(buffers[i]);
+        }
+    }
+
+    // writer side: slot to fill before calling publish()
+    T & getWriteBuffer(){
+        return buffers[back];
+    }
+
+    void publish(){
+        const int previous = spare.exchange(back | dirty, std::memory_order_acq_rel);
+        back = previous & index;
+    }
+
+    // reader side
+    bool hasNew() const {
+        return (spare.load(std::memory_order_acquire) & dirty) != 0;
+    }
+
+    // returns the newest published value. It stays valid until the next call.
+    const T & read(){
+        if (spare.load(std::memory_order_relaxed) & dirty) {
+            const int previous = spare.exchange(front, std::memory_order_acq_rel);
+            front = previous & index;
+        }
+        return buffers[front];
+    }
+
+private:
+
+    static const int index = 0x3;
+    static const int dirty = 0x4;
+
+    T buffers[3];
+    int back = 0;
+    int front = 1;
+    std::atomic<int> spare{2};
+};
@@ -0,0 +1,279 @@
+//
+//  ofxXeThruView.h
+//  Per consumer range windows and frame rates over one sensor's stream.
+//
+//  The acquisition thread writes every frame once into a short history
+//  shared by all views of the sensor. A view does nothing until it is
+//  pulled, then copies out only its bins of only the frame that is due
+//  at its rate, so a 1 fps consumer of a 1 m window pays for one small
+//  copy a second instead of a full frame at the module rate. Slots are
+//  seqlocked like the shared memory ring of ofxXeThruPublisher: the
+//  writer never waits for a view, a view that was lapped skips ahead.
+//
+
+#pragma once
+
+#include "ofxXeThruFrame.h"
+#include "ofxXeThruFramePool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+class ofxXeThruFrameHistory {
+
+public:
+
+    // capacity floats per frame, longer frames are cut
+    void allocate(size_t slots, size_t _capacity){
+        capacity = _capacity;
+        storage.assign(slots * capacity, 0.0f);
+        std::vector<Slot> fresh(slots);
+        headers.swap(fresh);
+        head = 0;
+    }
+
+    bool empty() const {
+        return headers.empty();
+    }
+
+    size_t size() const {
+        return headers.size();
+    }
+
+    // the X4 frame area a frame was captured with, the views work out
+    // their bins from it
+    struct Area {
+        float fa1 = 0;
+        float fa2 = 0;
+        bool downconversion = false;
+
+        bool operator==(const Area & other) const {
+            return fa1 == other.fa1 && fa2 == other.fa2 && downconversion == other.downconversion;
+        }
+    };
+
+    // single writer, the acquisition thread
+    void write(const ofxXeThruFrame & frame, const Area & area){
+        const uint64_t n = head.load(std::memory_order_relaxed);
+        Slot & slot = headers[n % headers.size()];
+        slot.sequence.store(2 * n + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.content_id = frame.content_id;
+        slot.info = frame.info;
+        slot.device_id = frame.device_id;
+        slot.timestamp = frame.timestamp;
+        slot.area = area;
+        slot.size = std::min(frame.data.size(), capacity);
+        std::memcpy(getData(n), frame.data.data(), slot.size * sizeof(float));
+        slot.sequence.store(2 * n + 2, std::memory_order_release);
+        head.store(n + 1, std::memory_order_release);
+    }
+
+    // frames written so far, frame n is in the history while n + size() > head
+    uint64_t getHead() const {
+        return head.load(std::memory_order_acquire);
+    }
+
+    // Copies the window(area, first, count) of frame n, and the same window
+    // of the second half of the frame when downconverted (I then Q). false
+    // when frame n was overwritten, before or during the copy.
+    template<typename Window>
+    bool read(uint64_t n, Window window, ofxXeThruFrame & frame) const {
+        const Slot & slot = headers[n % headers.size()];
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        if (before != 2 * n + 2) {
+            return false;
+        }
+        const Area area = slot.area;
+        const bool split = area.downconversion;
+        size_t first = 0;
+        size_t count = 0;
+        window(area, first, count);
+        const size_t size = slot.size;
+        const size_t half = split ? size / 2 : size;
+        first = std::min(first, half);
+        count = std::min(count, half - first);
+        frame.data.resize(split ? 2 * count : count);
+        const float * data = getData(n);
+        std::memcpy(frame.data.data(), data + first, count * sizeof(float));
+        if (split) {
+            std::memcpy(frame.data.data() + count, data + half + first, count * sizeof(float));
+        }
+        frame.content_id = slot.content_id;
+        frame.info = slot.info;
+        frame.device_id = slot.device_id;
+        frame.timestamp = slot.timestamp;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    // receive time of frame n without copying it, false when overwritten
+    bool getTimestamp(uint64_t n, uint64_t & timestamp) const {
+        const Slot & slot = headers[n % headers.size()];
+        const uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        timestamp = slot.timestamp;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return before == 2 * n + 2 && slot.sequence.load(std::memory_order_relaxed) == before;
+    }
+
+private:
+
+    struct Slot {
+        std::atomic<uint64_t> sequence{0};
+        uint32_t content_id = 0;
+        uint32_t info = 0;
+        int device_id = 0;
+        uint64_t timestamp = 0;
+        Area area;
+        size_t size = 0;
+    };
+
+    float * getData(uint64_t n){
+        return storage.data() + (n % headers.size()) * capacity;
+    }
+
+    const float * getData(uint64_t n) const {
+        return storage.data() + (n % headers.size()) * capacity;
+    }
+
+    std::vector<Slot> headers;
+    std::vector<float> storage;
+    size_t capacity = 0;
+    std::atomic<uint64_t> head{0};
+};
+
+class ofxXeThruView {
+
+public:
+
+    // range_start to range_end in meters, both 0 for the whole frame. fps
+    // 0 takes every frame, anything else the newest frame once per period.
+    ofxXeThruView(const ofxXeThruFrameHistory & _history, float _range_start, float _range_end, float _fps) :
+        history(_history), range_start(_range_start), range_end(_range_end), fps(_fps) {}
+
+    // Next frame due for this view, only its bins, I then Q of the window
+    // when downconverted. Never blocks. frame keeps its capacity.
+    bool getNextFrame(ofxXeThruFrame & frame){
+        if (history.empty()) {
+            return false;
+        }
+        const uint64_t head = history.getHead();
+        if (next >= head) {
+            return false;
+        }
+        if (head - next >= history.size()) {
+            // the writer may be in the oldest slot by now
+            const uint64_t oldest = head - history.size() + 1;
+            skipped += oldest - next;
+            next = oldest;
+        }
+        if (fps <= 0) {
+            return readFrom(next, head, frame);
+        }
+        // only the newest frame counts, and only once a period has passed
+        uint64_t newest_time = 0;
+        uint64_t previous_time = 0;
+        if (!history.getTimestamp(head - 1, newest_time)) {
+            return false;
+        }
+        // half a module frame of slack, so 1 fps out of 17 stays at 1 fps
+        // instead of slipping a frame every period
+        const uint64_t slack = head >= 2 && history.getTimestamp(head - 2, previous_time) && newest_time > previous_time ?
+            (newest_time - previous_time) / 2 : 0;
+        const uint64_t period = uint64_t(1e6f / fps);
+        if (delivered && newest_time + slack < last_time + period) {
+            return false;
+        }
+        skipped += head - 1 - next;
+        return readFrom(head - 1, head, frame);
+    }
+
+    // window of the last frame returned
+    size_t getFirstBin() const {
+        return first_bin;
+    }
+
+    size_t getNumBins() const {
+        return bin_count;
+    }
+
+    // range of the first bin of the window, meters
+    float getRangeStart() const {
+        return area.fa1 + first_bin * bin_length;
+    }
+
+    float getBinLength() const {
+        return bin_length;
+    }
+
+    float getFps() const {
+        return fps;
+    }
+
+    // frames this view didn't take, decimated or lapped
+    uint64_t getSkippedFrames() const {
+        return skipped;
+    }
+
+private:
+
+    // bins of the window in a frame of this area, worked out again only
+    // when the area changes
+    void resolve(const ofxXeThruFrameHistory::Area & frame_area, size_t & first, size_t & count){
+        if (!resolved || !(frame_area == area)) {
+            area = frame_area;
+            resolved = true;
+            const float rf_bin_length = 299792458.0f / (2.0f * 23.328e9f);
+            bin_length = area.downconversion ? rf_bin_length * 8 : rf_bin_length;
+            const size_t bins = ofxXeThruFramePool::getBinCount(area.fa1, area.fa2, area.downconversion);
+            if (range_start == 0 && range_end == 0) {
+                first_bin = 0;
+                bin_count = bins;
+            } else {
+                const float start = std::max(0.0f, (range_start - area.fa1) / bin_length);
+                const float end = std::max(start, (range_end - area.fa1) / bin_length);
+                first_bin = std::min<size_t>(std::floor(start), bins);
+                bin_count = std::min<size_t>(std::ceil(end), bins) - first_bin;
+            }
+        }
+        first = first_bin;
+        count = bin_count;
+    }
+
+    // the first frame from n on that is still intact
+    bool readFrom(uint64_t n, uint64_t head, ofxXeThruFrame & frame){
+        auto window = [this](const ofxXeThruFrameHistory::Area & frame_area, size_t & first, size_t & count){
+            resolve(frame_area, first, count);
+        };
+        for (; n < head; ++n) {
+            if (history.read(n, window, frame)) {
+                next = n + 1;
+                last_time = frame.timestamp;
+                delivered = true;
+                return true;
+            }
+            ++skipped;
+        }
+        next = head;
+        return false;
+    }
+
+    const ofxXeThruFrameHistory & history;
+    float range_start;
+    float range_end;
+    float fps;
+
+    ofxXeThruFrameHistory::Area area;
+    bool resolved = false;
+    float bin_length = 0;
+    size_t first_bin = 0;
+    size_t bin_count = 0;
+
+    uint64_t next = 0;
+    uint64_t last_time = 0;
+    bool delivered = false;
+    uint64_t skipped = 0;
+};
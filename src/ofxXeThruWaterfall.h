@@ -0,0 +1,193 @@
+//
+//  ofxXeThruWaterfall.h
+//  Range-time history of one sensor kept on the GPU. The history is a ring
+//  of rows in a float texture: each frame uploads a single row with
+//  glTexSubImage2D and the shader scrolls by offsetting the texture
+//  coordinate, so nothing already uploaded is ever copied again. Values are
+//  mapped through a colormap in the fragment shader.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "Data.hpp"
+
+#include <vector>
+
+class ofxXeThruWaterfall {
+
+public:
+
+    static const size_t default_rows = 256;
+
+    // rows of history kept, bins per row. Optional, the first row sets
+    // the bins up with default_rows of history.
+    void setup(size_t _bins, size_t _rows = default_rows){
+        bins = _bins;
+        rows = _rows;
+        if (rows == 0) {
+            rows = default_rows;
+        }
+        head = 0;
+
+        ofTextureData data;
+        data.width = bins;
+        data.height = rows;
+        data.tex_w = bins;
+        data.tex_h = rows;
+        data.tex_t = 1;
+        data.tex_u = 1;
+        data.textureTarget = GL_TEXTURE_2D;
+        data.glInternalFormat = GL_R32F;
+        texture.allocate(data, GL_RED, GL_FLOAT);
+        texture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+        texture.setTextureWrap(GL_CLAMP_TO_EDGE, GL_REPEAT);
+
+        // start from a blank history
+        std::vector<float> blank(bins * rows, range_min);
+        glBindTexture(GL_TEXTURE_2D, texture.getTextureData().textureID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bins, rows, GL_RED, GL_FLOAT, blank.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (!shader.isLoaded()) {
+            loadShader();
+        }
+    }
+
+    // appends one row, only that row goes over the bus
+    void addRow(const float * values, size_t count){
+        if (count != bins) {
+            setup(count, rows);
+        }
+        glBindTexture(GL_TEXTURE_2D, texture.getTextureData().textureID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, head, bins, 1, GL_RED, GL_FLOAT, values);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        head = (head + 1) % rows;
+    }
+
+    void addFrame(const XeThru::DataFloat & frame){
+        addRow(frame.data.data(), frame.data.size());
+    }
+
+    void addFrame(const XeThru::BasebandApData & frame){
+        addRow(frame.amplitude.data(), frame.amplitude.size());
+    }
+
+    // Doppler map from ofxXeThruDoppler or the module: one row per range
+    // bin, the whole texture is refreshed in a single upload
+    void setDopplerMap(const std::vector<XeThru::PulseDopplerFloatData> & matrix){
+        if (matrix.empty()) {
+            return;
+        }
+        const size_t frequencies = matrix[0].data.size();
+        if (frequencies != bins || matrix.size() != rows) {
+            setup(frequencies, matrix.size());
+        }
+        staging.resize(bins * rows);
+        for (size_t r = 0; r < rows; ++r) {
+            std::copy(matrix[r].data.begin(), matrix[r].data.end(), staging.begin() + r * bins);
+        }
+        glBindTexture(GL_TEXTURE_2D, texture.getTextureData().textureID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, bins, rows, GL_RED, GL_FLOAT, staging.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+        // a map has no scroll, range bin 0 ends up at the bottom
+        head = 0;
+    }
+
+    // values mapped to the ends of the colormap
+    void setRange(float _range_min, float _range_max){
+        range_min = _range_min;
+        range_max = _range_max;
+    }
+
+    // newest row at the top
+    void draw(float x, float y, float w, float h){
+        if (!texture.isAllocated()) {
+            return;
+        }
+        shader.begin();
+        shader.setUniformTexture("src_tex_unit0", texture, 0);
+        shader.setUniform1f("head", float(head) / rows);
+        shader.setUniform2f("range", range_min, range_max);
+        texture.draw(x, y, w, h);
+        shader.end();
+    }
+
+    const ofTexture & getTexture() const {
+        return texture;
+    }
+
+private:
+
+    void loadShader(){
+        // viridis polynomial fit, shared by both GLSL versions
+        const std::string colormap =
+            "vec3 colormap(float t){\n"
+            "    const vec3 c0 = vec3(0.2777273272, 0.0054073445, 0.3340998053);\n"
+            "    const vec3 c1 = vec3(0.1050930431, 1.4046135299, 1.3845901626);\n"
+            "    const vec3 c2 = vec3(-0.3308618287, 0.2148475595, 0.0950951630);\n"
+            "    const vec3 c3 = vec3(-4.6342304990, -5.7991009734, -19.3324409563);\n"
+            "    const vec3 c4 = vec3(6.2282699363, 14.1799333668, 56.6905526007);\n"
+            "    const vec3 c5 = vec3(4.7763849977, -13.7451453777, -65.3530326334);\n"
+            "    const vec3 c6 = vec3(-5.4354558559, 4.6458526122, 26.3124352496);\n"
+            "    return c0 + t * (c1 + t * (c2 + t * (c3 + t * (c4 + t * (c5 + t * c6)))));\n"
+            "}\n";
+
+        if (ofIsGLProgrammableRenderer()) {
+            shader.setupShaderFromSource(GL_VERTEX_SHADER,
+                "#version 150\n"
+                "uniform mat4 modelViewProjectionMatrix;\n"
+                "in vec4 position;\n"
+                "in vec2 texcoord;\n"
+                "out vec2 coord;\n"
+                "void main(){\n"
+                "    coord = texcoord;\n"
+                "    gl_Position = modelViewProjectionMatrix * position;\n"
+                "}\n");
+            shader.setupShaderFromSource(GL_FRAGMENT_SHADER,
+                "#version 150\n"
+                "uniform sampler2D src_tex_unit0;\n"
+                "uniform float head;\n"
+                "uniform vec2 range;\n"
+                "in vec2 coord;\n"
+                "out vec4 color;\n"
+                + colormap +
+                "void main(){\n"
+                "    float value = texture(src_tex_unit0, vec2(coord.x, head - coord.y)).r;\n"
+                "    float t = clamp((value - range.x) / (range.y - range.x), 0.0, 1.0);\n"
+                "    color = vec4(colormap(t), 1.0);\n"
+                "}\n");
+            shader.bindDefaults();
+        } else {
+            shader.setupShaderFromSource(GL_VERTEX_SHADER,
+                "#version 120\n"
+                "void main(){\n"
+                "    gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+                "    gl_Position = ftransform();\n"
+                "}\n");
+            shader.setupShaderFromSource(GL_FRAGMENT_SHADER,
+                "#version 120\n"
+                "uniform sampler2D src_tex_unit0;\n"
+                "uniform float head;\n"
+                "uniform vec2 range;\n"
+                + colormap +
+                "void main(){\n"
+                "    vec2 coord = gl_TexCoord[0].xy;\n"
+                "    float value = texture2D(src_tex_unit0, vec2(coord.x, head - coord.y)).r;\n"
+                "    float t = clamp((value - range.x) / (range.y - range.x), 0.0, 1.0);\n"
+                "    gl_FragColor = vec4(colormap(t), 1.0);\n"
+                "}\n");
+        }
+        shader.linkProgram();
+    }
+
+    ofTexture texture;
+    ofShader shader;
+    std::vector<float> staging;
+
+    size_t bins = 0;
+    size_t rows = default_rows;
+    size_t head = 0;
+    float range_min = 0;
+    float range_max = 1;
+};